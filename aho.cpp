@@ -0,0 +1,123 @@
+#include "aho.h"
+
+#include <cstring>
+
+
+AhoCorasick::AhoCorasick() {
+    memset(byteClass, 0, sizeof(byteClass));
+    numClasses = 1;
+}
+
+
+void AhoCorasick::add(const string &literal, int id) {
+    literals.push_back(literal);
+    ids.push_back(id);
+}
+
+
+int AhoCorasick::size() const {
+    return literals.size();
+}
+
+
+/* Builds the trie of the literals, then visits it breadth first to compute
+ * each state's failure state (the state of its longest proper suffix that
+ * is in the trie).  Missing transitions are filled in from the failure
+ * state, which is always visited first, so the table ends up complete.
+ */
+void AhoCorasick::build() {
+    memset(byteClass, 0, sizeof(byteClass));
+    numClasses = 1;
+    for (size_t i = 0; i < literals.size(); i++) {
+        for (size_t j = 0; j < literals[i].length(); j++) {
+            unsigned char c = literals[i][j];
+            if (byteClass[c] == 0)
+                byteClass[c] = numClasses++;
+        }
+    }
+
+    trans.assign(numClasses, -1);
+    firstOutput.assign(1, -1);
+    outputs.clear();
+
+    // The last of each state's own outputs, which is linked to the outputs
+    // of its failure state.
+    vector<int> lastOutput(1, -1);
+
+    for (size_t i = 0; i < literals.size(); i++) {
+        int st = 0;
+        for (size_t j = 0; j < literals[i].length(); j++) {
+            int k = byteClass[(unsigned char) literals[i][j]];
+            if (trans[st * numClasses + k] == -1) {
+                trans[st * numClasses + k] = firstOutput.size();
+                trans.resize(trans.size() + numClasses, -1);
+                firstOutput.push_back(-1);
+                lastOutput.push_back(-1);
+            }
+            st = trans[st * numClasses + k];
+        }
+
+        Output out = { ids[i], (int) literals[i].length(), firstOutput[st] };
+        outputs.push_back(out);
+        firstOutput[st] = outputs.size() - 1;
+        if (lastOutput[st] == -1)
+            lastOutput[st] = firstOutput[st];
+    }
+
+    vector<int> fail(firstOutput.size(), 0);
+    vector<int> queue;
+    for (int k = 0; k < numClasses; k++) {
+        int next = trans[k];
+        if (next == -1)
+            trans[k] = 0;
+        else
+            queue.push_back(next);
+    }
+
+    for (size_t q = 0; q < queue.size(); q++) {
+        int st = queue[q];
+        int f = fail[st];
+
+        if (lastOutput[st] != -1)
+            outputs[lastOutput[st]].next = firstOutput[f];
+        else
+            firstOutput[st] = firstOutput[f];
+
+        for (int k = 0; k < numClasses; k++) {
+            int &next = trans[st * numClasses + k];
+            if (next == -1) {
+                next = trans[f * numClasses + k];
+            }
+            else {
+                fail[next] = trans[f * numClasses + k];
+                queue.push_back(next);
+            }
+        }
+    }
+}
+
+
+void AhoCorasick::findFirst(const char *data, int len, vector<char> &matched,
+                            vector<Range> &ranges, int &numMatched,
+                            int stopAt) const {
+    if (literals.empty() || numMatched >= stopAt)
+        return;
+
+    int st = 0;
+    for (int i = 0; i < len; i++) {
+        st = trans[st * numClasses + byteClass[(unsigned char) data[i]]];
+
+        for (int o = firstOutput[st]; o != -1; o = outputs[o].next) {
+            const Output &out = outputs[o];
+            if (matched[out.id])
+                continue;
+
+            // The text is read left to right, so this is the literal's
+            // leftmost occurrence.
+            matched[out.id] = 1;
+            ranges[out.id] = Range(i + 1 - out.len, i + 1);
+            if (++numMatched == stopAt)
+                return;
+        }
+    }
+}
@@ -0,0 +1,60 @@
+#ifndef AHO_HH
+#define AHO_HH
+
+#include "./regex.h"
+
+
+/* An Aho-Corasick automaton that finds many literal strings in one pass.
+ * The trie's failure links are folded into a full transition table when it
+ * is built, so every byte of input costs exactly one lookup.
+ *
+ * To keep the table small and dense, bytes are first mapped to classes:
+ * each byte that occurs in some literal gets a class of its own, and all
+ * the other bytes share class 0.  A state's row then has one entry per
+ * class instead of 256, and the rows are stored one after the other.
+ *
+ * The literals that end at a state are kept as a linked list of outputs,
+ * and a state's list continues with the list of its failure state, so every
+ * suffix of the text read so far that is a literal is found by following
+ * one list.
+ */
+class AhoCorasick {
+    struct Output {
+        int id;
+        int len;
+        int next;
+    };
+
+    vector<string> literals;
+    vector<int> ids;
+
+    uint16_t byteClass[256];
+    int numClasses;
+
+    // The transitions of state s are trans[s * numClasses, ...).
+    vector<int> trans;
+
+    // The first output of each state, or -1.
+    vector<int> firstOutput;
+    vector<Output> outputs;
+
+public:
+    AhoCorasick();
+
+    // Adds a non-empty literal, reported as pattern "id".
+    void add(const string &literal, int id);
+
+    // Builds the automaton; call after the last add().
+    void build();
+
+    int size() const;
+
+    // Finds where each literal first occurs in data[0, len).  For every
+    // literal found whose id is not yet set in "matched", sets matched[id],
+    // stores its range in ranges[id] and increments "numMatched".  Stops as
+    // soon as "numMatched" reaches "stopAt".
+    void findFirst(const char *data, int len, vector<char> &matched,
+                   vector<Range> &ranges, int &numMatched, int stopAt) const;
+};
+
+#endif // AHO_HH
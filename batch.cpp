@@ -0,0 +1,63 @@
+#include "batch.h"
+
+
+// The number of inputs a worker takes at a time; one word of the bitmap.
+const size_t BATCH_GRAIN = 64;
+
+
+size_t MatchBitmap::count() const {
+    size_t total = 0;
+    for (size_t i = 0; i < words.size(); i++)
+        total += __builtin_popcountll(words[i]);
+    return total;
+}
+
+
+MatchBitmap matchBatch(const CompiledRegex &regex,
+                       const string_view *inputs, size_t n, ThreadPool &pool,
+                       EngineType engine) {
+    MatchBitmap result(n);
+    vector<MatchScratch> scratch(pool.size());
+
+    pool.parallelFor(n, BATCH_GRAIN, [&](int w, size_t lo, size_t hi) {
+        uint64_t word = 0;
+        for (size_t i = lo; i < hi; i++) {
+            if (match(regex, inputs[i], scratch[w], engine))
+                word |= (uint64_t) 1 << (i - lo);
+        }
+        result.words[lo / 64] = word;
+    });
+
+    return result;
+}
+
+
+MatchBitmap matchBatch(const CompiledRegex &regex,
+                       const vector<string> &inputs, ThreadPool &pool,
+                       EngineType engine) {
+    vector<string_view> views(inputs.begin(), inputs.end());
+    return matchBatch(regex, views.data(), views.size(), pool, engine);
+}
+
+
+vector<Range> findBatch(const CompiledRegex &regex,
+                        const string_view *inputs, size_t n, ThreadPool &pool,
+                        EngineType engine) {
+    vector<Range> result(n);
+    vector<MatchScratch> scratch(pool.size());
+
+    pool.parallelFor(n, BATCH_GRAIN, [&](int w, size_t lo, size_t hi) {
+        for (size_t i = lo; i < hi; i++)
+            result[i] = find(regex, inputs[i], scratch[w], engine);
+    });
+
+    return result;
+}
+
+
+vector<Range> findBatch(const CompiledRegex &regex,
+                        const vector<string> &inputs, ThreadPool &pool,
+                        EngineType engine) {
+    vector<string_view> views(inputs.begin(), inputs.end());
+    return findBatch(regex, views.data(), views.size(), pool, engine);
+}
@@ -0,0 +1,56 @@
+#ifndef BATCH_HH
+#define BATCH_HH
+
+#include "./engine.h"
+#include "./threadpool.h"
+
+
+/* One bit per input of a batch, set if the regex matched it. */
+class MatchBitmap {
+    vector<uint64_t> words;
+    size_t n;
+
+public:
+    explicit MatchBitmap(size_t n = 0) : words((n + 63) / 64, 0), n(n) { }
+
+    size_t size() const {
+        return n;
+    }
+
+    bool test(size_t i) const {
+        return (words[i >> 6] >> (i & 63)) & 1;
+    }
+
+    // Returns the number of inputs that matched.
+    size_t count() const;
+
+    friend MatchBitmap matchBatch(const CompiledRegex &regex,
+                                  const string_view *inputs, size_t n,
+                                  ThreadPool &pool, EngineType engine);
+};
+
+
+/* Runs match() or find() on every input of a batch, spread over the
+ * threads of the pool, each with its own MatchScratch.  Inputs are handed
+ * out 64 at a time, so that each thread fills whole words of the bitmap,
+ * and the pool splits the work further wherever some inputs take longer
+ * than others.
+ *
+ * The inputs are views, so a batch can be sliced straight out of a log
+ * buffer or a memory-mapped file without copying each line.
+ */
+MatchBitmap matchBatch(const CompiledRegex &regex,
+                       const string_view *inputs, size_t n, ThreadPool &pool,
+                       EngineType engine = ENGINE_BACKTRACK);
+MatchBitmap matchBatch(const CompiledRegex &regex,
+                       const vector<string> &inputs, ThreadPool &pool,
+                       EngineType engine = ENGINE_BACKTRACK);
+
+vector<Range> findBatch(const CompiledRegex &regex,
+                        const string_view *inputs, size_t n, ThreadPool &pool,
+                        EngineType engine = ENGINE_BACKTRACK);
+vector<Range> findBatch(const CompiledRegex &regex,
+                        const vector<string> &inputs, ThreadPool &pool,
+                        EngineType engine = ENGINE_BACKTRACK);
+
+#endif // BATCH_HH
@@ -0,0 +1,174 @@
+#include "compiled.h"
+
+#include <algorithm>
+#include <atomic>
+
+
+// The id of the next regex to be compiled.
+static atomic<unsigned long long> nextId(1);
+
+
+CompiledRegex::CompiledRegex(const string &expr,
+                             pmr::memory_resource *resource) :
+    arena(REGEX_ARENA_BYTES),
+    resource(resource != NULL ? resource : &arena),
+    program(this->resource), prefilter(this->resource),
+    scanners(this->resource), forward(this->resource),
+    reverse(this->resource), jitCalls(0), jit(NULL) {
+    pmr::vector<RegexOperator *> regex = parseRegex(expr, this->resource);
+    compile(regex.data(), regex.size());
+    clearRegex(regex, this->resource);
+}
+
+
+CompiledRegex::CompiledRegex(const vector<RegexOperator *> &regex,
+                             pmr::memory_resource *resource) :
+    arena(REGEX_ARENA_BYTES),
+    resource(resource != NULL ? resource : &arena),
+    program(this->resource), prefilter(this->resource),
+    scanners(this->resource), forward(this->resource),
+    reverse(this->resource), jitCalls(0), jit(NULL) {
+    compile(regex.data(), regex.size());
+}
+
+
+CompiledRegex::~CompiledRegex() {
+    delete jit.load();
+}
+
+
+/* Builds the programs every engine runs from the operators.  They are built
+ * in the regex's memory resource and then moved into place, which does not
+ * copy them since the resources are the same.
+ */
+void CompiledRegex::compile(RegexOperator *const *regex, size_t n) {
+    program = compileProgram(regex, n, resource);
+    prefilter = buildPrefilter(program, resource);
+    scanners.reserve(program.getNumClasses());
+    for (int i = 0; i < program.getNumClasses(); i++)
+        scanners.push_back(ClassScanner(program.getClass(i)));
+    forward = compileNFA(program, false, resource);
+    reverse = compileNFA(program, true, resource);
+    id = nextId++;
+}
+
+
+const Program &CompiledRegex::getProgram() const {
+    return program;
+}
+
+
+const Prefilter &CompiledRegex::getPrefilter() const {
+    return prefilter;
+}
+
+
+const ClassScanner &CompiledRegex::getScanner(int cls) const {
+    return scanners[cls];
+}
+
+
+const NFAProgram &CompiledRegex::getForward() const {
+    return forward;
+}
+
+
+const NFAProgram &CompiledRegex::getReverse() const {
+    return reverse;
+}
+
+
+unsigned long long CompiledRegex::getId() const {
+    return id;
+}
+
+
+SearchCounters CompiledRegex::getStats() const {
+    return stats.get();
+}
+
+
+void CompiledRegex::resetStats() const {
+    stats.reset();
+}
+
+
+void CompiledRegex::addStats(const SearchCounters &counters) const {
+    stats.add(counters);
+}
+
+
+const JitProgram *CompiledRegex::getJit() const {
+    return jit.load(memory_order_acquire);
+}
+
+
+/* Only the search that brings the count to the threshold compiles, so the
+ * program is compiled at most once, and a program the JIT cannot compile is
+ * not tried again.  Other threads keep interpreting until it is installed.
+ */
+const JitProgram *CompiledRegex::countJitCall() const {
+    JitProgram *compiled = jit.load(memory_order_acquire);
+    if (compiled != NULL || !JitProgram::isSupported())
+        return compiled;
+    if (jitCalls.fetch_add(1, memory_order_relaxed) + 1 != JIT_THRESHOLD_CALLS)
+        return NULL;
+
+    compiled = new JitProgram(program);
+    if (!compiled->ok()) {
+        delete compiled;
+        return NULL;
+    }
+    jit.store(compiled, memory_order_release);
+    return compiled;
+}
+
+
+bool FailedStates::reset(int numInsts, int from, int len) {
+    // Clear what the previous search marked.
+    if (high >= base) {
+        size_t used = index(this->numInsts - 1, high) + 1;
+        fill(bits.begin(), bits.begin() + (used + 63) / 64, 0);
+    }
+
+    size_t needed = (size_t) (len - from + 1) * numInsts;
+    if (needed > BACKTRACK_MEMO_BYTES * 8) {
+        high = base - 1;
+        return false;
+    }
+    if (bits.size() < (needed + 63) / 64)
+        bits.resize((needed + 63) / 64, 0);
+
+    this->numInsts = numInsts;
+    base = from;
+    high = from - 1;
+    return true;
+}
+
+
+MatchScratch::MatchScratch(size_t dfaCacheBytes) :
+    dfaCacheBytes(dfaCacheBytes), dfaOwner(0), counting(false),
+    tracer(NULL) { }
+
+
+DFACache &MatchScratch::getForwardCache(const CompiledRegex &regex) {
+    if (dfaOwner != regex.getId()) {
+        forwardCache.reset(new DFACache(regex.getForward(),
+                                        dfaCacheBytes / 2, DFA_LEFTMOST));
+        reverseCache.reset(new DFACache(regex.getReverse(),
+                                        dfaCacheBytes / 2, DFA_LONGEST));
+        dfaOwner = regex.getId();
+    }
+    return *forwardCache;
+}
+
+
+DFACache &MatchScratch::getReverseCache(const CompiledRegex &regex) {
+    getForwardCache(regex);
+    return *reverseCache;
+}
+
+
+DFAStats &MatchScratch::getDFAStats() {
+    return dfaStats;
+}
@@ -0,0 +1,196 @@
+#ifndef COMPILED_HH
+#define COMPILED_HH
+
+#include "./dfa.h"
+#include "./instrument.h"
+#include "./jit.h"
+#include "./prefilter.h"
+#include "./simd.h"
+
+#include <memory>
+
+
+// The size of the first block of a CompiledRegex's own arena; enough for
+// the whole of a typical regex.
+const size_t REGEX_ARENA_BYTES = 2048;
+
+
+/* A regex that has been parsed and compiled for every engine.  It is never
+ * modified after construction, so one CompiledRegex can be shared by any
+ * number of threads, as long as each thread searches with its own
+ * MatchScratch.
+ *
+ * Everything a CompiledRegex allocates, from the parsed operators to the
+ * programs it keeps, comes from one memory resource, except for the JIT's
+ * compiled program (see "jit" below).  By default that is a
+ * monotonic arena owned by the regex, so compiling takes a few calls to
+ * malloc() instead of dozens, the programs sit next to each other in
+ * memory, and the arena is freed in one go with the regex.  A caller that
+ * creates many short-lived regexes can pass in its own resource instead,
+ * such as an arena that it releases once they are all gone; the resource
+ * must outlive the regex.
+ */
+class CompiledRegex {
+    pmr::monotonic_buffer_resource arena;
+    pmr::memory_resource *resource;
+
+    Program program;
+    Prefilter prefilter;
+
+    // The program's classes, prepared for the SIMD kernels.
+    pmr::vector<ClassScanner> scanners;
+
+    NFAProgram forward;
+    NFAProgram reverse;
+
+    // Tells apart the regexes a MatchScratch has been used with.
+    unsigned long long id;
+
+    // The work of the searches that counted it.  The only part of a
+    // CompiledRegex that changes, and atomic, so sharing it is still safe.
+    mutable PatternStats stats;
+
+    // The program compiled to machine code once ENGINE_BACKTRACK has
+    // searched with the regex JIT_THRESHOLD_CALLS times, and the count of
+    // those searches.  Set once, by the search that reaches the threshold.
+    // Unlike the rest of the regex, it comes from the heap: it is created
+    // by a search, on any thread, and a memory resource such as a
+    // monotonic arena may only be used by one thread at a time, while the
+    // caller may be compiling other regexes from it.  Its code lives in
+    // pages of its own anyway.
+    mutable atomic<long long> jitCalls;
+    mutable atomic<JitProgram *> jit;
+
+    void compile(RegexOperator *const *regex, size_t n);
+
+public:
+    // Parses and compiles the regex.  If "resource" is NULL, the regex
+    // allocates from its own arena.
+    explicit CompiledRegex(const string &expr,
+                           pmr::memory_resource *resource = NULL);
+
+    // Compiles an already parsed regex.  The operators are not kept, so the
+    // caller may free them right away.
+    explicit CompiledRegex(const vector<RegexOperator *> &regex,
+                           pmr::memory_resource *resource = NULL);
+
+    ~CompiledRegex();
+
+    CompiledRegex(const CompiledRegex &) = delete;
+    CompiledRegex &operator=(const CompiledRegex &) = delete;
+
+    const Program &getProgram() const;
+    const Prefilter &getPrefilter() const;
+    const ClassScanner &getScanner(int cls) const;
+    const NFAProgram &getForward() const;
+    const NFAProgram &getReverse() const;
+    unsigned long long getId() const;
+
+    // The counters of every search with this regex from a MatchScratch
+    // that counts its work, added up since the last reset.
+    SearchCounters getStats() const;
+    void resetStats() const;
+    void addStats(const SearchCounters &counters) const;
+
+    // Returns the program compiled to machine code, or NULL if it has not
+    // been compiled.
+    const JitProgram *getJit() const;
+
+    // Counts a search with ENGINE_BACKTRACK, compiling the program once
+    // there have been JIT_THRESHOLD_CALLS of them; then returns getJit().
+    const JitProgram *countJitCall() const;
+};
+
+
+// The most memory ENGINE_BACKTRACK_MEMO may use for its record of failed
+// states; larger searches fall back to the Pike VM.
+const size_t BACKTRACK_MEMO_BYTES = 8 << 20;
+
+
+/* For the backtracking engine with memoization, one bit per pair of an
+ * instruction and an input position, set once applying the rest of the
+ * program from that instruction at that position is known to fail.  Since
+ * the program is a plain sequence, that does not depend on where the match
+ * started, so the bits stay valid for every start index of a search.
+ *
+ * Only the positions marked since the last reset are cleared, so resetting
+ * costs as much as the search that set them, not the size of the input.
+ */
+class FailedStates {
+    vector<uint64_t> bits;
+    int numInsts;
+
+    // The first position of the search, and the highest position marked.
+    int base;
+    int high;
+
+    size_t index(int inst, int pos) const {
+        return (size_t) (pos - base) * numInsts + inst;
+    }
+
+public:
+    FailedStates() : numInsts(0), base(0), high(-1) { }
+
+    // Prepares for a search of positions from to len of the input.  Returns
+    // false if that needs more than BACKTRACK_MEMO_BYTES.
+    bool reset(int numInsts, int from, int len);
+
+    bool test(int inst, int pos) const {
+        size_t i = index(inst, pos);
+        return (bits[i >> 6] >> (i & 63)) & 1;
+    }
+
+    void set(int inst, int pos) {
+        size_t i = index(inst, pos);
+        bits[i >> 6] |= (uint64_t) 1 << (i & 63);
+        if (pos > high)
+            high = pos;
+    }
+};
+
+
+/* The mutable state a search needs: the backtracking engine's record of what
+ * each instruction matched, the Pike VM's thread lists and the lazy DFA's state
+ * caches.  Each thread should own one MatchScratch and reuse it for all its
+ * searches; once its buffers have grown to fit the regex and the input,
+ * searching does not allocate.
+ *
+ * The DFA caches belong to the regex they were built for.  They are kept as
+ * long as the scratch is used with the same CompiledRegex, and rebuilt when
+ * it is used with a different one.
+ */
+class MatchScratch {
+    size_t dfaCacheBytes;
+    unsigned long long dfaOwner;
+    unique_ptr<DFACache> forwardCache;
+    unique_ptr<DFACache> reverseCache;
+    DFAStats dfaStats;
+
+public:
+    // For the backtracking engine, the run each instruction has matched.
+    vector<RunState> runs;
+
+    // For ENGINE_BACKTRACK_MEMO, the states known to fail.
+    FailedStates failed;
+
+    // Set "counting" to count the work of each search in "counters", which
+    // then holds the counters of the last search, and to add them to the
+    // regex's stats.  Off by default, when searches count nothing.
+    bool counting;
+    SearchCounters counters;
+
+    // If not NULL, told about every step of the backtracking engines.
+    SearchTracer *tracer;
+
+    PikeScratch pike;
+
+    explicit MatchScratch(size_t dfaCacheBytes = DFA_DEFAULT_CACHE_BYTES);
+
+    // Returns the DFA caches for the regex, building new ones if needed.
+    DFACache &getForwardCache(const CompiledRegex &regex);
+    DFACache &getReverseCache(const CompiledRegex &regex);
+
+    DFAStats &getDFAStats();
+};
+
+#endif // COMPILED_HH
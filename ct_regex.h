@@ -0,0 +1,351 @@
+#ifndef CT_REGEX_HH
+#define CT_REGEX_HH
+
+#include "./regex.h"
+
+// Regexes given as template arguments need C++20; the rest of the engine
+// only needs C++17, so this header is empty in older modes.
+#if __cplusplus >= 202002L
+
+#include <cstddef>
+
+
+/* A string literal that can be passed as a template argument, such as the
+ * "\\d+" of StaticRegex<"\\d+">.
+ */
+template <size_t N>
+struct FixedString {
+    char chars[N];
+
+    constexpr FixedString(const char (&s)[N]) : chars() {
+        for (size_t i = 0; i < N; i++)
+            chars[i] = s[i];
+    }
+
+    constexpr size_t length() const {
+        return N - 1;
+    }
+};
+
+
+/* A CharClass that can be built and tested at compile time. */
+struct StaticClass {
+    uint64_t bits[4] = { 0, 0, 0, 0 };
+
+    constexpr void add(unsigned char c) {
+        bits[c >> 6] |= (uint64_t) 1 << (c & 63);
+    }
+
+    constexpr void addRange(unsigned char lo, unsigned char hi) {
+        for (int c = lo; c <= hi; c++)
+            add(c);
+    }
+
+    constexpr void addAll() {
+        bits[0] = bits[1] = bits[2] = bits[3] = ~(uint64_t) 0;
+    }
+
+    constexpr void invert() {
+        for (int i = 0; i < 4; i++)
+            bits[i] = ~bits[i];
+    }
+
+    constexpr bool contains(unsigned char c) const {
+        return (bits[c >> 6] >> (c & 63)) & 1;
+    }
+
+    // The lowest and highest characters in the class, or -1 if it is empty.
+    constexpr int lowest() const {
+        for (int c = 0; c < 256; c++) {
+            if (contains(c))
+                return c;
+        }
+        return -1;
+    }
+
+    constexpr int highest() const {
+        for (int c = 255; c >= 0; c--) {
+            if (contains(c))
+                return c;
+        }
+        return -1;
+    }
+
+    // Returns true if the class holds every character from lowest() to
+    // highest(), and no others.
+    constexpr bool isRange() const {
+        int lo = lowest();
+        if (lo == -1)
+            return false;
+        for (int c = lo; c <= highest(); c++) {
+            if (!contains(c))
+                return false;
+        }
+        return true;
+    }
+};
+
+
+/* One operator of a StaticRegex: a class and how often it repeats. */
+struct StaticOp {
+    StaticClass cls;
+    int minRepeat = 1;
+    int maxRepeat = 1;
+
+    // Set as compileProgram() sets INST_POSSESSIVE.
+    bool possessive = false;
+};
+
+
+/* The operators of a pattern of N - 1 characters, which has at most that
+ * many of them.
+ */
+template <size_t N>
+struct StaticProgram {
+    StaticOp ops[N];
+    int size = 0;
+};
+
+
+/* Adds the contents of a set written between [ and ] to the class, as
+ * addSubset() does for the runtime parser.
+ */
+constexpr void addStaticSubset(StaticClass &cls, const char *str, int len) {
+    for (int i = 0; i < len; i++) {
+        if (i + 2 < len && str[i + 1] == '-') {
+            cls.addRange(str[i], str[i + 2]);
+            i = i + 2;
+        }
+        else
+            cls.add(str[i]);
+    }
+}
+
+
+/* Parses a pattern with the same grammar as parseRegex(), at compile time.
+ * Patterns parseRegex() would assert on, or that use an escape it does not
+ * know, fail to compile.
+ */
+template <size_t N>
+constexpr StaticProgram<N> parseStatic(const FixedString<N> &pattern) {
+    StaticProgram<N> prog;
+    const char *expr = pattern.chars;
+    int len = pattern.length();
+
+    for (int i = 0; i < len; i++) {
+        StaticOp op;
+        int endIndex = i + 1;
+
+        if (expr[i] == '[') {
+            int close = i + 1;
+            while (close < len && expr[close] != ']')
+                close++;
+            if (close == len)
+                throw "unterminated [";
+
+            if (i + 1 < len && expr[i + 1] == '^') {
+                addStaticSubset(op.cls, expr + i + 2, close - i - 2);
+                op.cls.invert();
+            }
+            else
+                addStaticSubset(op.cls, expr + i + 1, close - i - 1);
+            endIndex = close + 1;
+        }
+        else if (expr[i] == '\\') {
+            // A backslash at the end of the pattern is ignored.
+            if (i + 1 == len)
+                continue;
+
+            endIndex = i + 2;
+            if (expr[i + 1] == '.' || expr[i + 1] == '\\')
+                op.cls.add(expr[i + 1]);
+            else if (expr[i + 1] == 'd')
+                op.cls.addRange('0', '9');
+            else if (expr[i + 1] == 'w') {
+                op.cls.addRange('a', 'z');
+                op.cls.addRange('A', 'Z');
+                op.cls.addRange('0', '9');
+                op.cls.add('_');
+            }
+            else if (expr[i + 1] == 's')
+                op.cls.add(' ');
+            else
+                throw "unknown escape";
+        }
+        else if (expr[i] == '.')
+            op.cls.addAll();
+        else
+            op.cls.add(expr[i]);
+
+        if (endIndex < len) {
+            if (expr[endIndex] == '*') {
+                op.minRepeat = 0;
+                op.maxRepeat = -1;
+                endIndex++;
+            }
+            else if (expr[endIndex] == '+') {
+                op.minRepeat = 1;
+                op.maxRepeat = -1;
+                endIndex++;
+            }
+            else if (expr[endIndex] == '?') {
+                op.minRepeat = 0;
+                op.maxRepeat = 1;
+                endIndex++;
+            }
+            else if (expr[endIndex] == '{' && endIndex + 2 < len) {
+                // {n} and {n,m}, with single digit counts.  Anything else
+                // leaves the { to be read as a character.
+                int minRep = expr[endIndex + 1] - '0';
+                if (endIndex + 4 < len && expr[endIndex + 2] == ',' &&
+                    expr[endIndex + 4] == '}') {
+                    op.minRepeat = minRep;
+                    op.maxRepeat = expr[endIndex + 3] - '0';
+                    endIndex += 5;
+                }
+                else if (expr[endIndex + 2] == '}') {
+                    op.minRepeat = minRep;
+                    op.maxRepeat = minRep;
+                    endIndex += 3;
+                }
+            }
+        }
+
+        prog.ops[prog.size++] = op;
+        i = endIndex - 1;
+    }
+
+    for (int i = 0; i < prog.size; i++) {
+        const StaticOp &op = prog.ops[i];
+        if (op.minRepeat == op.maxRepeat)
+            continue;
+
+        int last = i + 1;
+        while (last < prog.size && prog.ops[last].minRepeat == 0)
+            last++;
+        if (last == prog.size)
+            last--;
+
+        bool overlaps = false;
+        for (int c = 0; c < 256 && !overlaps; c++) {
+            if (!op.cls.contains(c))
+                continue;
+            for (int j = i + 1; j <= last; j++) {
+                if (prog.ops[j].cls.contains(c))
+                    overlaps = true;
+            }
+        }
+        prog.ops[i].possessive = !overlaps;
+    }
+    return prog;
+}
+
+
+/* A regex fixed at compile time, such as StaticRegex<"\\d{4}-\\d\\d">.
+ *
+ * The pattern is parsed by parseStatic() while compiling, and every operator
+ * becomes its own function, specialized for its class and repeat counts:
+ * one character is a compare, a range such as \d two, and only other
+ * classes need a bitmap lookup.  Nothing is allocated and nothing is called
+ * through a vtable.  find() and match() return the same results as the
+ * runtime engines, and backtrack in the same order as findAtIndex(), so a
+ * pathological pattern is as slow here as it is there.
+ */
+template <FixedString Pattern>
+class StaticRegex {
+    static constexpr StaticProgram<sizeof(Pattern.chars)> prog =
+        parseStatic(Pattern);
+
+    template <int I>
+    static bool test(unsigned char c) {
+        constexpr StaticClass cls = prog.ops[I].cls;
+        constexpr int lo = cls.lowest();
+        constexpr int hi = cls.highest();
+
+        if constexpr (lo == 0 && hi == 255 && cls.isRange())
+            return true;
+        else if constexpr (lo == hi)
+            return c == lo;
+        else if constexpr (cls.isRange())
+            return (unsigned) (c - lo) <= (unsigned) (hi - lo);
+        else
+            return cls.contains(c);
+    }
+
+    /* Applies operators I and on at index "pos", trying the longest run of
+     * operator I first.  Returns where the match ends, or -1 if there is
+     * none; with AnchorEnd, only a match that ends at "len" will do.
+     */
+    template <int I, bool AnchorEnd>
+    static int matchFrom(const unsigned char *data, int len, int pos) {
+        if constexpr (I == prog.size) {
+            if constexpr (AnchorEnd)
+                return pos == len ? pos : -1;
+            else
+                return pos;
+        }
+        else {
+            constexpr int minRepeat = prog.ops[I].minRepeat;
+            constexpr int maxRepeat = prog.ops[I].maxRepeat;
+
+            int limit = len - pos;
+            if (maxRepeat != -1 && maxRepeat < limit)
+                limit = maxRepeat;
+
+            int n = 0;
+            while (n < limit && test<I>(data[pos + n]))
+                n++;
+
+            // The last operator of an anchored match has to run to the end.
+            if constexpr (AnchorEnd && I == prog.size - 1)
+                return n >= minRepeat && pos + n == len ? len : -1;
+
+            // A possessive operator only tries its whole run.
+            constexpr bool possessive = prog.ops[I].possessive;
+            int fewest = possessive ? n : minRepeat;
+            if (n < minRepeat)
+                return -1;
+            for (int k = n; k >= fewest; k--) {
+                int end = matchFrom<I + 1, AnchorEnd>(data, len, pos + k);
+                if (end != -1)
+                    return end;
+            }
+            return -1;
+        }
+    }
+
+public:
+    // The number of operators in the pattern.
+    static constexpr int size() {
+        return prog.size;
+    }
+
+    static Range find(const char *data, int len) {
+        const unsigned char *bytes = (const unsigned char *) data;
+        for (int start = 0; start < len; start++) {
+            int end = matchFrom<0, false>(bytes, len, start);
+            if (end != -1)
+                return Range(start, end);
+        }
+        return Range(-1, -1);
+    }
+
+    static Range find(const string &s) {
+        return find(s.data(), s.length());
+    }
+
+    // Like match(), only tries index 0 and never matches the empty string.
+    static bool match(const char *data, int len) {
+        if (len == 0)
+            return false;
+        return matchFrom<0, true>((const unsigned char *) data, len, 0) != -1;
+    }
+
+    static bool match(const string &s) {
+        return match(s.data(), s.length());
+    }
+};
+
+#endif // __cplusplus >= 202002L
+
+#endif // CT_REGEX_HH
@@ -0,0 +1,392 @@
+#include "dfa.h"
+
+#include <algorithm>
+
+
+// Flags stored with every DFA state.
+//   STATE_MATCH    the state's thread list contains NFA_MATCH.
+//   STATE_SEEDING  a new match attempt is started after every character.
+const int STATE_MATCH = 1;
+const int STATE_SEEDING = 2;
+
+// A flush is treated as thrashing if the DFA consumed fewer than this many
+// bytes per cached state since the previous flush.
+const int MIN_BYTES_PER_STATE = 10;
+
+
+DFACache::DFACache(const NFAProgram &prog, size_t maxBytes, DFAMode mode) :
+    prog(prog), maxBytes(maxBytes), mode(mode), memoryUsed(0),
+    visited(prog.insts.size(), 0), visitGen(0), runGen(0) {
+    startStates[0] = startStates[1] = -1;
+}
+
+
+/* Appends the NFA_BYTE and NFA_MATCH instructions reachable from "pc" to the
+ * thread list, in priority order, skipping instructions already visited in
+ * this list.  Returns true if NFA_MATCH was reached; in leftmost-first mode
+ * nothing is added after it.
+ */
+bool DFACache::addClosure(int pc, vector<int> &out) {
+    stack.clear();
+    stack.push_back(pc);
+
+    while (!stack.empty()) {
+        pc = stack.back();
+        stack.pop_back();
+
+        if (visited[pc] == visitGen)
+            continue;
+        visited[pc] = visitGen;
+
+        const NFAInst &inst = prog.insts[pc];
+        if (inst.opcode == NFA_JMP) {
+            stack.push_back(inst.x);
+        }
+        else if (inst.opcode == NFA_SPLIT) {
+            stack.push_back(inst.y);
+            stack.push_back(inst.x);
+        }
+        else {
+            out.push_back(pc);
+            if (inst.opcode == NFA_MATCH && mode == DFA_LEFTMOST)
+                return true;
+        }
+    }
+
+    return false;
+}
+
+
+/* Returns the index of the state with the given thread list and flags,
+ * adding it to the cache if needed.  Returns -1 if the state is new and the
+ * cache has no room for it.
+ */
+int DFACache::lookup(const vector<int> &insts, int flags) {
+    string key((const char *) insts.data(), insts.size() * sizeof(int));
+    key.push_back((char) flags);
+
+    auto iter = index.find(key);
+    if (iter != index.end())
+        return iter->second;
+
+    size_t cost = sizeof(DFAState) + insts.size() * sizeof(int) +
+        256 * sizeof(int) + 2 * key.size();
+    if (memoryUsed + cost > maxBytes)
+        return -1;
+
+    DFAState state;
+    state.insts = insts;
+    state.flags = flags;
+    state.reported = 0;
+    if (mode == DFA_ALL) {
+        for (size_t i = 0; i < insts.size(); i++) {
+            const NFAInst &inst = prog.insts[insts[i]];
+            if (inst.opcode == NFA_MATCH)
+                state.patterns.push_back(inst.x);
+        }
+        cost += state.patterns.size() * sizeof(int);
+    }
+    states.push_back(state);
+    trans.resize(trans.size() + 256, -1);
+    memoryUsed += cost;
+
+    int st = (int) states.size() - 1;
+    index[key] = st;
+    return st;
+}
+
+
+/* Returns true if the thread list contains an NFA_MATCH instruction. */
+static bool hasMatch(const NFAProgram &prog, const vector<int> &list) {
+    for (size_t i = 0; i < list.size(); i++) {
+        if (prog.insts[list[i]].opcode == NFA_MATCH)
+            return true;
+    }
+    return false;
+}
+
+
+/* Computes the thread list that state "st" moves to on character "c", and
+ * the flags of that state.  The list is left in "list".
+ */
+int DFACache::computeNext(int st, unsigned char c, int &flags) {
+    const DFAState &state = states[st];
+
+    list.clear();
+    visitGen++;
+    flags = 0;
+
+    for (size_t i = 0; i < state.insts.size(); i++) {
+        const NFAInst &inst = prog.insts[state.insts[i]];
+        if (inst.opcode != NFA_BYTE)
+            continue;
+
+        if (prog.classes[inst.cls].contains(c) && addClosure(inst.x, list)) {
+            flags |= STATE_MATCH;
+            break;
+        }
+    }
+
+    // Like the Pike VM, keep starting new attempts until a match is seen.
+    // When looking for every match, keep starting them regardless.
+    if ((state.flags & STATE_SEEDING) && (mode == DFA_ALL ||
+        (!(state.flags & STATE_MATCH) && !(flags & STATE_MATCH)))) {
+        flags |= STATE_SEEDING;
+        if (addClosure(prog.start, list))
+            flags |= STATE_MATCH;
+    }
+
+    if (mode != DFA_LEFTMOST && hasMatch(prog, list))
+        flags |= STATE_MATCH;
+
+    return (int) list.size();
+}
+
+
+/* Returns the state "st" moves to on character "c", computing it from the
+ * NFA if it is not cached yet.  When the cache is full it is flushed, and
+ * "flushPos" is set to "pos".  Returns -1 if the cache is thrashing: it
+ * was already flushed ("flushed" is true) and fewer than
+ * MIN_BYTES_PER_STATE bytes per state were consumed since.
+ */
+int DFACache::transition(int st, unsigned char c, int pos, int &flushPos,
+                         bool &flushed, DFAStats &stats) {
+    int next = trans[st * 256 + c];
+    if (next >= 0) {
+        stats.hits++;
+        return next;
+    }
+
+    stats.misses++;
+    int flags;
+    computeNext(st, c, flags);
+    next = lookup(list, flags);
+    if (next != -1) {
+        trans[st * 256 + c] = next;
+        return next;
+    }
+
+    int progress = pos > flushPos ? pos - flushPos : flushPos - pos;
+    if (flushed && progress < MIN_BYTES_PER_STATE * (int) states.size())
+        return -1;
+
+    flush();
+    stats.flushes++;
+    flushed = true;
+    flushPos = pos;
+    return lookup(list, flags);
+}
+
+
+/* Returns the state a run starts in, or -1 if it does not fit in the cache
+ * even after a flush.  The start states are remembered until the next
+ * flush, since computing them costs as much as a whole run over a short
+ * string.
+ */
+int DFACache::startState(bool anchored, DFAStats &stats) {
+    if (startStates[anchored] != -1)
+        return startStates[anchored];
+
+    list.clear();
+    visitGen++;
+    int flags = anchored ? 0 : STATE_SEEDING;
+    if (addClosure(prog.start, list))
+        flags = STATE_MATCH;
+    if (mode != DFA_LEFTMOST && hasMatch(prog, list))
+        flags |= STATE_MATCH;
+
+    int st = lookup(list, flags);
+    if (st == -1) {
+        flush();
+        stats.flushes++;
+        st = lookup(list, flags);
+    }
+    startStates[anchored] = st;
+    return st;
+}
+
+
+/* Throws away every state in the cache. */
+void DFACache::flush() {
+    startStates[0] = startStates[1] = -1;
+    states.clear();
+    trans.clear();
+    index.clear();
+    memoryUsed = 0;
+}
+
+
+/* Runs the DFA over the string from index "from" toward index "stop",
+ * moving backward if "stop" is before "from", until it reaches "stop" or no
+ * thread is left alive.
+ * "lastMatch" is set to the last index at which the DFA was in a matching
+ * state, or -1 if there was none.  Forward runs in leftmost-first mode
+ * report the end of the match the Pike VM would choose; backward runs in
+ * longest mode report the start of the longest match ending at "from".
+ *
+ * Returns false if the cache thrashed and the search should be redone with
+ * the Pike VM.
+ */
+bool DFACache::run(const char *text, int from, int stop, bool anchored,
+                   int &lastMatch, DFAStats &stats) {
+    const unsigned char *data = (const unsigned char *) text;
+    bool reverse = stop < from;
+    int step = reverse ? -1 : 1;
+
+    // Every position has to be consumed MIN_BYTES_PER_STATE times over
+    // between flushes for the cache to be worth keeping.
+    int flushPos = from;
+    bool flushed = false;
+
+    int st = startState(anchored, stats);
+    if (st == -1)
+        return false;
+
+    lastMatch = -1;
+    int pos = from;
+    while (true) {
+        const DFAState &state = states[st];
+        if (state.flags & STATE_MATCH)
+            lastMatch = pos;
+        if (pos == stop)
+            break;
+        if (state.insts.empty() && !(state.flags & STATE_SEEDING))
+            break;
+
+        unsigned char c = reverse ? data[pos - 1] : data[pos];
+        st = transition(st, c, pos, flushPos, flushed, stats);
+        if (st == -1)
+            return false;
+        pos += step;
+    }
+
+    return true;
+}
+
+
+/* Runs the DFA over the whole string in all-matches mode, setting
+ * matched[id] for every pattern "id" that matches somewhere in it, and
+ * counting the newly matched patterns in "numMatched".  Stops early once
+ * "numMatched" reaches "stopAt".  Like find(), matches only start at indexes
+ * inside the string, so nothing matches an empty string.
+ *
+ * Returns false if the cache thrashed; "matched" then holds the patterns
+ * found so far.
+ */
+bool DFACache::runAll(const char *text, int len, vector<char> &matched,
+                      int &numMatched, int stopAt, DFAStats &stats) {
+    const unsigned char *data = (const unsigned char *) text;
+    if (len == 0)
+        return true;
+
+    int flushPos = 0;
+    bool flushed = false;
+    runGen++;
+
+    int st = startState(false, stats);
+    if (st == -1)
+        return false;
+
+    int pos = 0;
+    while (true) {
+        DFAState &state = states[st];
+
+        // A state's matches only need reporting the first time it is seen.
+        if ((state.flags & STATE_MATCH) && state.reported != runGen) {
+            state.reported = runGen;
+            for (size_t i = 0; i < state.patterns.size(); i++) {
+                int id = state.patterns[i];
+                if (!matched[id]) {
+                    matched[id] = 1;
+                    numMatched++;
+                }
+            }
+            if (numMatched >= stopAt)
+                break;
+        }
+        if (pos == len)
+            break;
+
+        st = transition(st, data[pos], pos, flushPos, flushed, stats);
+        if (st == -1)
+            return false;
+        pos++;
+    }
+
+    return true;
+}
+
+
+LazyDFA::LazyDFA(const vector<RegexOperator *> &regex, size_t maxCacheBytes) :
+    forward(compileNFA(compileProgram(regex))),
+    reverse(compileNFA(compileProgram(regex), true)),
+    forwardCache(forward, maxCacheBytes / 2, DFA_LEFTMOST),
+    reverseCache(reverse, maxCacheBytes / 2, DFA_LONGEST) { }
+
+
+/* Finds the leftmost match in the string with the forward and reverse DFAs,
+ * returning the same range as the other engines, or the range (-1, -1) if
+ * there is no match.  Match attempts start at "from" or later.
+ */
+Range dfaFind(const NFAProgram &forward, DFACache &forwardCache,
+              DFACache &reverseCache, const char *data, int len,
+              PikeScratch &pike, DFAStats &stats, int from) {
+    if (from >= len)
+        return Range(-1, -1);
+
+    int end, start;
+    if (!forwardCache.run(data, from, len, false, end, stats)) {
+        stats.fallbacks++;
+        return pikeFind(forward, data, len, pike, from);
+    }
+    if (end == -1)
+        return Range(-1, -1);
+
+    // Every character of a match is consumed by one operator, so the
+    // reversed regex matches the reversed string.  The longest match that
+    // ends at "end" without starting before "from" is the leftmost one.
+    if (!reverseCache.run(data, end, from, true, start, stats)) {
+        stats.fallbacks++;
+        return pikeFind(forward, data, len, pike, from);
+    }
+
+    return Range(start, end);
+}
+
+
+/* Returns true if the match found at index 0 covers the whole string. */
+bool dfaMatch(const NFAProgram &forward, DFACache &forwardCache,
+              const char *data, int len, PikeScratch &pike, DFAStats &stats) {
+    if (len == 0)
+        return false;
+
+    int end;
+    if (!forwardCache.run(data, 0, len, true, end, stats)) {
+        stats.fallbacks++;
+        Range r = pikeFind(forward, data, len, pike);
+        return r.start == 0 && r.end == len;
+    }
+
+    return end == len;
+}
+
+
+Range LazyDFA::find(const string &s) {
+    return dfaFind(forward, forwardCache, reverseCache, s.data(), s.length(),
+                   pike, stats);
+}
+
+
+bool LazyDFA::match(const string &s) {
+    return dfaMatch(forward, forwardCache, s.data(), s.length(), pike, stats);
+}
+
+
+const DFAStats &LazyDFA::getStats() const {
+    return stats;
+}
+
+
+void LazyDFA::resetStats() {
+    stats = DFAStats();
+}
@@ -0,0 +1,142 @@
+#ifndef DFA_HH
+#define DFA_HH
+
+#include "./nfa.h"
+
+#include <string>
+#include <unordered_map>
+
+
+// The default memory cap of a lazy DFA's state cache, in bytes.
+const size_t DFA_DEFAULT_CACHE_BYTES = 1 << 20;
+
+
+/* Counters that describe how well a lazy DFA's state cache is working. */
+struct DFAStats {
+    // Transitions that were found in the cache.
+    long long hits;
+
+    // Transitions that had to be computed from the NFA.
+    long long misses;
+
+    // Times the cache was cleared because it reached its memory cap.
+    long long flushes;
+
+    // Searches handed to the Pike VM because the cache was thrashing.
+    long long fallbacks;
+
+    DFAStats() : hits(0), misses(0), flushes(0), fallbacks(0) { }
+};
+
+
+/* What a DFA's matching states stand for.
+ *
+ *   DFA_LEFTMOST  the match the Pike VM would choose (leftmost-first).
+ *   DFA_LONGEST   the longest match.
+ *   DFA_ALL       every match of every pattern in a merged NFA, such as the
+ *                 one a RegexSet builds.  Each NFA_MATCH instruction holds
+ *                 the number of its pattern in "x".
+ */
+enum DFAMode {
+    DFA_LEFTMOST,
+    DFA_LONGEST,
+    DFA_ALL
+};
+
+
+/* The part of a lazily built DFA that has been built so far.  Each DFA state
+ * is an ordered list of NFA threads (the NFA_BYTE and NFA_MATCH instructions
+ * that are alive), and its transitions are computed from the NFA the first
+ * time they are needed.  States are stored until they use up "maxBytes" of
+ * memory, at which point the whole cache is cleared and rebuilt on demand.
+ *
+ * In leftmost-first mode the thread lists keep the Pike VM's priority order
+ * and drop every thread after a match, so the DFA ends its matches exactly
+ * where the Pike VM does.  In longest mode every thread is kept, and the DFA
+ * finds the longest match.  In all-matches mode every thread is kept and a
+ * new match attempt starts at every index, so the states passed through
+ * tell which patterns match anywhere in the input.
+ *
+ * The cache refers to the NFA it was built for, which must outlive it.
+ */
+class DFACache {
+    struct DFAState {
+        vector<int> insts;
+        int flags;
+
+        // In all-matches mode, the patterns whose NFA_MATCH is in the
+        // state, and the last runAll() that reported them.
+        vector<int> patterns;
+        int reported;
+    };
+
+    const NFAProgram &prog;
+    size_t maxBytes;
+    DFAMode mode;
+
+    vector<DFAState> states;
+    vector<int> trans;
+    unordered_map<string, int> index;
+    size_t memoryUsed;
+
+    // Scratch space for computing thread lists.
+    vector<int> visited;
+    int visitGen;
+    vector<int> stack;
+    vector<int> list;
+    int runGen;
+
+    // The cached start states of unanchored and anchored runs, or -1.
+    int startStates[2];
+
+    bool addClosure(int pc, vector<int> &out);
+    int lookup(const vector<int> &insts, int flags);
+    int computeNext(int st, unsigned char c, int &flags);
+    int transition(int st, unsigned char c, int pos, int &flushPos,
+                   bool &flushed, DFAStats &stats);
+    int startState(bool anchored, DFAStats &stats);
+    void flush();
+
+public:
+    DFACache(const NFAProgram &prog, size_t maxBytes, DFAMode mode);
+
+    bool run(const char *data, int from, int stop, bool anchored,
+             int &lastMatch, DFAStats &stats);
+    bool runAll(const char *data, int len, vector<char> &matched,
+                int &numMatched, int stopAt, DFAStats &stats);
+};
+
+
+Range dfaFind(const NFAProgram &forward, DFACache &forwardCache,
+              DFACache &reverseCache, const char *data, int len,
+              PikeScratch &pike, DFAStats &stats, int from = 0);
+bool dfaMatch(const NFAProgram &forward, DFACache &forwardCache,
+              const char *data, int len, PikeScratch &pike, DFAStats &stats);
+
+
+/* A regex compiled for searching with a lazily built DFA.  find() runs a
+ * forward DFA to find where the leftmost match ends, and then a reverse DFA
+ * from that point to find where it starts, so each byte of input usually
+ * costs a single table lookup.  When the cache thrashes, the search falls
+ * back to the Pike VM.
+ */
+class LazyDFA {
+    NFAProgram forward;
+    NFAProgram reverse;
+    DFACache forwardCache;
+    DFACache reverseCache;
+    PikeScratch pike;
+    DFAStats stats;
+
+public:
+    LazyDFA(const vector<RegexOperator *> &regex,
+            size_t maxCacheBytes = DFA_DEFAULT_CACHE_BYTES);
+
+    Range find(const string &s);
+    bool match(const string &s);
+
+    const DFAStats &getStats() const;
+    void resetStats();
+};
+
+#endif // DFA_HH
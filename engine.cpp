@@ -1,12 +1,74 @@
 #include "engine.h"
 
-#include <iostream>
+#include <climits>
+#include <stdexcept>
 
 
-// Set this to 1 if you need to see the output of the regular expression
-// matching engine as it attempts to match.  You should not need to do this
-// for the assignment, only if you decide to play with the engine itself.
-#define VERBOSE 0
+/* Counts the steps of a search with MatchLimits, and tells the backtracking
+ * engine when to give up.
+ */
+class SearchBudget {
+    typedef chrono::steady_clock Clock;
+
+    const MatchLimits &limits;
+    Clock::time_point deadline;
+
+public:
+    long long steps;
+    MatchStatus status;
+
+    explicit SearchBudget(const MatchLimits &limits) :
+        limits(limits), steps(0), status(MATCH_NOT_FOUND) {
+        if (limits.timeout.count() > 0)
+            deadline = Clock::now() + limits.timeout;
+    }
+
+    // Takes a step; returns false if the search has to give up.
+    bool step() {
+        if (limits.maxSteps > 0 && steps == limits.maxSteps) {
+            status = MATCH_STEP_LIMIT;
+            return false;
+        }
+        steps++;
+        if (limits.timeout.count() > 0 && steps % MATCH_CLOCK_STEPS == 0 &&
+            Clock::now() >= deadline) {
+            status = MATCH_TIMEOUT;
+            return false;
+        }
+        return true;
+    }
+
+    bool exhausted() const {
+        return status == MATCH_STEP_LIMIT || status == MATCH_TIMEOUT;
+    }
+};
+
+
+/* The optional parts of a backtracking search, each NULL when not in use:
+ *
+ *   failed    every (instruction, position) state the search backtracks out
+ *             of is marked in it, and states marked by earlier calls are not
+ *             tried again.  That bounds a search over all start indexes by
+ *             the number of states, instead of the number of ways to split
+ *             the input between the repeats.
+ *   budget    each application of an operator takes a step from it, and the
+ *             search gives up with the range (-1, -1) once it is used up.
+ *   counters  counts the work of the search.
+ *   tracer    is told about every step.
+ *   jit       the program compiled to machine code, which runs the search
+ *             instead when none of the others are in use.
+ *
+ * If "anchorEnd" is set, a match has to end at the end of the input, and
+ * the engine backtracks from any match that ends earlier.
+ */
+struct SearchHooks {
+    FailedStates *failed;
+    SearchBudget *budget;
+    SearchCounters *counters;
+    SearchTracer *tracer;
+    const JitProgram *jit;
+    bool anchorEnd;
+};
 
 
 /* This helper function implements the core of the regular-expression matching
@@ -15,101 +77,137 @@
  * finds it is unable to achieve matches.
  *
  * The function will attempt to find a match starting at the specific index
- * start.
+ * start.  It runs the regex's flat program, and what each instruction has
+ * matched is recorded in the scratch space, so the regex itself is never
+ * modified.
  *
  * If the function cannot generate a match, it will return the range (-1, -1).
  */
-Range findAtIndex(vector<RegexOperator *> regex, const string &s, int start) {
-    if (VERBOSE) {
-        cout << string(78, '-') << endl;
-        cout << "Find regex in \"" << s << "\", starting at index " << start
-             << endl;
+static Range findAtIndex(const CompiledRegex &compiled, const char *text,
+                         int len, int start, MatchScratch &scratch,
+                         const SearchHooks &hooks) {
+    const Program &prog = compiled.getProgram();
+    const unsigned char *data = (const unsigned char *) text;
+    vector<RunState> &runs = scratch.runs;
+    if ((int) runs.size() < prog.size())
+        runs.resize(prog.size());
+
+    if (hooks.jit != NULL) {
+        int end = hooks.jit->matchAt(text, len, start, hooks.anchorEnd,
+                                     runs.data());
+        return end == -1 ? Range(-1, -1) : Range(start, end);
     }
+
+    FailedStates *failed = hooks.failed;
+    SearchCounters *counters = hooks.counters;
+    SearchTracer *tracer = hooks.tracer;
+
+    if (counters != NULL)
+        counters->startsTried++;
+    if (tracer != NULL)
+        tracer->onStart(text, len, start);
     
     Range matched(start, start);
 
-    // Keep track of the parts of the regex we have applied, so that we can
-    // figure out what needs backtracking.
-    vector<RegexOperator *> applied;
+    // Operators 0 to opIndex - 1 have been applied; their runs are kept so
+    // that we can figure out what needs backtracking.
     int opIndex = 0;
-    while (opIndex < (int) regex.size()) {
-        assert(opIndex == (int) applied.size());
-        
-        // Get the next operator to apply.
-        RegexOperator *op = regex[opIndex];
-        op->clearMatches();
-        
-        Range currentOp(matched.end, matched.end);
+    while (opIndex < prog.size()) {
+        if (hooks.budget != NULL && !hooks.budget->step()) {
+            matched.start = -1;
+            matched.end = -1;
+            break;
+        }
 
-        if (VERBOSE)
-            cout << "Attempting to apply operator : " << opIndex << endl;
+        // Get the next operator to apply.
+        const Inst &op = prog[opIndex];
+        RunState &run = runs[opIndex];
 
         // Apply the operator as many times as possible, up to the maximum
         // number of repetitions allowed.
+        int pos = matched.end;
+        int limit = len - pos;
+        if (op.maxRepeat != -1 && op.maxRepeat < limit)
+            limit = op.maxRepeat;
+
+        // A state that has failed before will fail again.
+        bool knownFailed = failed != NULL && failed->test(opIndex, pos);
+        if (knownFailed)
+            limit = 0;
+
+        // The SIMD kernels test 16 or 32 characters at a time.
         int numMatches = 0;
-        while (op->getMaxRepeat() == -1 || numMatches < op->getMaxRepeat()) {
-            Range iter(currentOp.end, currentOp.end);
-            // If we get a match, record the range that we match on, so that
-            // we can backtrack if needed.
-            if (op->match(s, iter)) {
-                op->pushMatch(iter);
-
-                if (VERBOSE) {
-                    cout << " * Matched range [" << iter.start << ", "
-                         << iter.end << ")" << endl;
-                }
+        switch (op.opcode) {
+        case OP_CHAR:
+            numMatches = charRun(op.arg, data + pos, limit);
+            break;
+        case OP_CLASS:
+            numMatches = classRun(compiled.getScanner(op.arg), data + pos,
+                                  limit);
+            break;
+        default:
+            numMatches = limit;
+            break;
+        }
 
-                currentOp.end = iter.end;
-                numMatches++;
-            }
-            else {
-                break;
-            }
+        // Every match is one character, so where the run starts and how
+        // long it is are all we need to backtrack.
+        run.start = pos;
+        run.count = numMatches;
+        int runEnd = pos + numMatches;
+
+        bool success = !knownFailed && numMatches >= op.minRepeat;
+
+        // The last operator can only reach the end of the input if its
+        // longest run does.
+        if (success && hooks.anchorEnd && opIndex == prog.size() - 1 &&
+            runEnd != len)
+            success = false;
+        if (counters != NULL) {
+            counters->operatorsApplied++;
+            counters->bytesScanned += numMatches;
         }
+        if (tracer != NULL)
+            tracer->onApply(opIndex, pos, numMatches, success);
 
         // If we applied the operator at least as many times as required, then
         // we are good!
-        if (numMatches >= op->getMinRepeat()) {
+        if (success) {
             // Successfully matched this operator!
 
-            if (VERBOSE)
-                cout << " * Success" << endl;
-
             // Record that the operator was applied, and update the
             // "matched range"
-            applied.push_back(op);
-            matched.end = currentOp.end;
+            matched.end = runEnd;
             opIndex++;
         }
         else {
             // Match failure.  Need to backtrack.  If I backtrack to the very
             // beginning, match failed.
+
+            // Where the operator being un-applied started.
+            int failedAt = pos;
+            if (failed != NULL)
+                failed->set(opIndex, failedAt);
             
-            if (VERBOSE) {
-                cout << " * Failed to match at least " << op->getMinRepeat()
-                     << " time(s)" << endl;
-                
-                cout << "Backtracking" << endl;
-            }
-            
-            while (!applied.empty()) {
-                RegexOperator *btOp = applied.back();
-                if (btOp->numMatches() > btOp->getMinRepeat()) {
+            while (opIndex > 0) {
+                const Inst &btOp = prog[opIndex - 1];
+                RunState &btRun = runs[opIndex - 1];
+                if (counters != NULL)
+                    counters->backtracks++;
+
+                // A possessive operator giving back characters cannot help
+                // the operators after it, so it is un-applied at once.
+                bool possessive = btOp.flags & INST_POSSESSIVE;
+                if (!possessive && btRun.count > btOp.minRepeat) {
                     // The current operator has been applied more than the
                     // minimum number of times.  Remove one application of
                     // this operation, and retry from that point.
-                    
-                    if (VERBOSE) {
-                        cout << " * Operator " << (opIndex - 1)
-                             << " has been applied " << btOp->numMatches()
-                             << " times (" << btOp->getMinRepeat()
-                             << " required); trying one less" << endl;
-                    }
 
-                    Range popped = btOp->popMatch();
-                    currentOp.end = popped.start;
-                    matched.end = popped.start;
+                    btRun.count--;
+                    matched.end = btRun.start + btRun.count;
 
+                    if (tracer != NULL)
+                        tracer->onGiveBack(opIndex - 1, matched.end);
                     break;
                 }
                 else {
@@ -117,21 +215,20 @@ Range findAtIndex(vector<RegexOperator *> regex, const string &s, int start) {
                     // times, but maybe we can't apply the operation at all
                     // yet.  Remove it from the sequence and try again.
                     
-                    applied.pop_back();
                     opIndex--;
+                    failedAt = btRun.start;
+                    if (failed != NULL)
+                        failed->set(opIndex, failedAt);
 
-                    if (VERBOSE)
-                        cout << " * Un-applying operator " << opIndex << endl;
+                    if (tracer != NULL)
+                        tracer->onUnapply(opIndex);
                 }
             }
             
-            if (applied.empty()) {
+            if (opIndex == 0) {
                 // We backtracked all the way to the beginning.  Total match
                 // failure; nothing we do will achieve a match.
                 
-                if (VERBOSE)
-                    cout << "Match failed, giving up" << endl;
-                
                 matched.start = -1;
                 matched.end = -1;
                 break;
@@ -139,27 +236,99 @@ Range findAtIndex(vector<RegexOperator *> regex, const string &s, int start) {
         }
     }
 
-    if (VERBOSE) {
-        if (applied.size() == regex.size()) {
-            cout << "Match succeeded on range [" << matched.start << ", "
-                 << matched.end << ")" << endl;
-        }
-        
-        // cout << string(78, '-') << endl;
+    // Without operators, the loop never checks the end.
+    if (hooks.anchorEnd && matched.end != len) {
+        matched.start = -1;
+        matched.end = -1;
     }
+
+    if (tracer != NULL)
+        tracer->onEnd(matched);
     
     return matched;
 }
 
 
-Range find(vector<RegexOperator *> regex, const string &s)
+/* Tries findAtIndex() at every index from "from" on that is close enough to
+ * an occurrence of the regex's required literal, jumping from one occurrence
+ * to the next.  Start indexes that cannot reach an occurrence are skipped,
+ * and the search stops as soon as the literal does not occur again.
+ */
+static Range findWithPrefilter(const CompiledRegex &regex, const char *data,
+                               int len, int from, MatchScratch &scratch,
+                               const SearchHooks &hooks)
 {
-    int len = s.length();
+    const Prefilter &pf = regex.getPrefilter();
+    int i = from;
+    while(i < len)
+    {
+        int next = pf.next(data, len, i + pf.minOffset);
+        if(next == -1)
+            break;
+
+        // Starts before next - maxOffset would need an earlier occurrence,
+        // and there is none.
+        if(pf.maxOffset != -1 and next - pf.maxOffset > i)
+            i = next - pf.maxOffset;
+
+        // Starts after next - minOffset need a later occurrence.
+        for(; i <= next - pf.minOffset and i < len; i++)
+        {
+            Range r = findAtIndex(regex, data, len, i, scratch, hooks);
+            if(r.start != -1 or
+               (hooks.budget != NULL and hooks.budget->exhausted()))
+                return r;
+        }
+    }
+    return Range(-1, -1);
+}
+
+
+/* Finds the leftmost match that starts at index "from" or later, with the
+ * engine picked by the caller.
+ */
+static Range search(const CompiledRegex &regex, const char *data, int len,
+                    int from, MatchScratch &scratch, EngineType engine,
+                    SearchHooks hooks)
+{
+    const Prefilter &pf = regex.getPrefilter();
+
+    // Skip ahead to the first start index worth trying.
+    if(!pf.empty())
+    {
+        int next = pf.next(data, len, from + pf.minOffset);
+        if(next == -1)
+            return Range(-1, -1);
+        if(pf.maxOffset != -1 and next - pf.maxOffset > from)
+            from = next - pf.maxOffset;
+    }
+
+    if(engine == ENGINE_PIKEVM)
+        return pikeFind(regex.getForward(), data, len, scratch.pike, from);
+    if(engine == ENGINE_DFA)
+        return dfaFind(regex.getForward(), scratch.getForwardCache(regex),
+                       scratch.getReverseCache(regex), data, len, scratch.pike,
+                       scratch.getDFAStats(), from);
+
+    // The record of failed states is shared by every start index, and
+    // falls back to the Pike VM when it would take too much memory.
+    if(engine == ENGINE_BACKTRACK_MEMO)
+    {
+        hooks.failed = &scratch.failed;
+        if(!hooks.failed->reset(regex.getProgram().size(), from, len))
+            return pikeFind(regex.getForward(), data, len, scratch.pike, from);
+    }
+
+    if(!pf.empty())
+        return findWithPrefilter(regex, data, len, from, scratch, hooks);
+
     bool found = 0;
     Range result(-1, -1);
-    for(int i=0; i<len; i++)
+    for(int i=from; i<len; i++)
     {
-        Range r = findAtIndex(regex, s, i);
+        Range r = findAtIndex(regex, data, len, i, scratch, hooks);
+        if(hooks.budget != NULL and hooks.budget->exhausted())
+            break;
         if(r.start == -1 and r.end == -1)
             found = 0;
         else found = 1;
@@ -173,14 +342,323 @@ Range find(vector<RegexOperator *> regex, const string &s)
     return result;
 }
 
-bool match(vector<RegexOperator *> regex, const string &s)
+
+/* Returns true if the whole of data[0, len) matches.  The backtracking
+ * engines only try index 0, and backtrack until they find a match that
+ * ends at the end of the input, rather than stopping at the first match.
+ */
+static bool matchWhole(const CompiledRegex &regex, const char *data,
+                       int len, MatchScratch &scratch, EngineType engine,
+                       SearchHooks hooks)
 {
-    Range result = find(regex, s);
-    if(result.start == 0 and result.end == (int)s.length())
-        return true;
+    // Like find(), matches only start at indexes inside the string.
+    if(len == 0)
+        return false;
+
+    if(engine == ENGINE_PIKEVM)
+        return pikeMatch(regex.getForward(), data, len, scratch.pike);
+    if(engine == ENGINE_DFA)
+        return dfaMatch(regex.getForward(), scratch.getForwardCache(regex),
+                        data, len, scratch.pike, scratch.getDFAStats());
+
+    if(engine == ENGINE_BACKTRACK_MEMO)
+    {
+        hooks.failed = &scratch.failed;
+        if(!hooks.failed->reset(regex.getProgram().size(), 0, len))
+            return pikeMatch(regex.getForward(), data, len, scratch.pike);
+    }
+
+    hooks.anchorEnd = true;
+    return findAtIndex(regex, data, len, 0, scratch, hooks).start == 0;
+}
+
+
+/* Sets up the hooks of a search.  The backtracking engines take their
+ * steps from "budget", if it is not NULL.  If the scratch counts its work,
+ * the counters of the search are left in it; endSearch() adds them to the
+ * regex's stats.  A plain ENGINE_BACKTRACK search, with no budget, counters
+ * or tracer, counts towards compiling the regex and then runs its machine
+ * code.
+ */
+static SearchHooks startSearch(const CompiledRegex &regex,
+                               MatchScratch &scratch, EngineType engine,
+                               SearchBudget *budget)
+{
+    SearchHooks hooks = { NULL, budget, NULL, scratch.tracer, NULL, false };
+    if(scratch.counting)
+    {
+        scratch.counters = SearchCounters();
+        scratch.counters.searches = 1;
+        hooks.counters = &scratch.counters;
+    }
+    if(engine == ENGINE_BACKTRACK and budget == NULL and
+       hooks.counters == NULL and hooks.tracer == NULL)
+        hooks.jit = regex.countJitCall();
+    return hooks;
+}
+
+static void endSearch(const CompiledRegex &regex, const SearchHooks &hooks)
+{
+    if(hooks.counters != NULL)
+        regex.addStats(*hooks.counters);
+}
+
+
+/* Finds the leftmost match that starts at index "from" or later. */
+static Range findFrom(const CompiledRegex &regex, const char *data, int len,
+                      int from, MatchScratch &scratch, EngineType engine,
+                      SearchBudget *budget = NULL)
+{
+    SearchHooks hooks = startSearch(regex, scratch, engine, budget);
+    Range result = search(regex, data, len, from, scratch, engine, hooks);
+    endSearch(regex, hooks);
+    return result;
+}
+
+
+/* Returns true if the whole string matches, after checking that it holds
+ * the regex's required literal close enough to its start.
+ */
+static bool matchFrom(const CompiledRegex &regex, const char *data, int len,
+                      MatchScratch &scratch, EngineType engine,
+                      SearchBudget *budget = NULL)
+{
+    const Prefilter &pf = regex.getPrefilter();
+    if(!pf.empty())
+    {
+        int next = pf.next(data, len, pf.minOffset);
+        if(next == -1 or (pf.maxOffset != -1 and next > pf.maxOffset))
+            return false;
+    }
+
+    SearchHooks hooks = startSearch(regex, scratch, engine, budget);
+    bool result = matchWhole(regex, data, len, scratch, engine, hooks);
+    endSearch(regex, hooks);
+    return result;
+}
+
+/* Throws length_error if the string is too long for the int offsets of a
+ * Range.  Such strings are searched with findLong() or findAllLong().
+ */
+static void checkLength(string_view s, const char *caller)
+{
+    if(s.length() > INT_MAX)
+        throw length_error(string(caller) + "(): the string is longer "
+                           "than INT_MAX bytes; use findLong() or "
+                           "findAllLong()");
+}
+
+Range find(const CompiledRegex &regex, const char *data, int len,
+           MatchScratch &scratch, EngineType engine)
+{
+    return findFrom(regex, data, len, 0, scratch, engine);
+}
+
+Range find(const CompiledRegex &regex, string_view s, MatchScratch &scratch,
+           EngineType engine)
+{
+    checkLength(s, "find");
+    return findFrom(regex, s.data(), s.length(), 0, scratch, engine);
+}
+
+bool match(const CompiledRegex &regex, const char *data, int len,
+           MatchScratch &scratch, EngineType engine)
+{
+    return matchFrom(regex, data, len, scratch, engine);
+}
+
+bool match(const CompiledRegex &regex, string_view s, MatchScratch &scratch,
+           EngineType engine)
+{
+    if(s.length() > INT_MAX)
+        return pikeMatch(regex.getForward(), s.data(), s.length(),
+                         scratch.pike);
+    return matchFrom(regex, s.data(), s.length(), scratch, engine);
+}
+
+/* Collects the bytes a match of the program can start with: those of every
+ * instruction up to and including the first one that has to match.
+ * Returns false if every instruction can match nothing, when a match can
+ * start anywhere.
+ */
+static bool firstBytes(const Program &prog, CharClass &first)
+{
+    for(int i=0; i<prog.size(); i++)
+    {
+        CharClass cls = prog.classOf(prog[i]);
+        for(int c=0; c<256; c++)
+        {
+            if(cls.contains(c))
+                first.add(c);
+        }
+        if(prog[i].minRepeat > 0)
+            return true;
+    }
     return false;
 }
 
+/* Like findFrom(), for strings of any length.  Strings too long for the
+ * int offsets of the other engines are searched by the Pike VM.
+ */
+static LongRange findLongFrom(const CompiledRegex &regex, string_view s,
+                              long long from, MatchScratch &scratch,
+                              EngineType engine)
+{
+    if(s.length() <= INT_MAX)
+    {
+        Range r = findFrom(regex, s.data(), s.length(), from, scratch,
+                           engine);
+        return LongRange(r.start, r.end);
+    }
+
+    CharClass first;
+    bool skip = firstBytes(regex.getProgram(), first);
+    SearchHooks hooks = startSearch(regex, scratch, ENGINE_PIKEVM, NULL);
+    LongRange result = pikeFindLong(regex.getForward(), s.data(), s.length(),
+                                    scratch.pike, from,
+                                    skip ? &first : NULL);
+    endSearch(regex, hooks);
+    return result;
+}
+
+LongRange findLong(const CompiledRegex &regex, string_view s,
+                   MatchScratch &scratch, EngineType engine)
+{
+    return findLongFrom(regex, s, 0, scratch, engine);
+}
+
+vector<LongRange> findAllLong(const CompiledRegex &regex, string_view s,
+                              MatchScratch &scratch, EngineType engine)
+{
+    vector<LongRange> result;
+    long long pos = 0;
+    while(pos < (long long) s.length())
+    {
+        LongRange r = findLongFrom(regex, s, pos, scratch, engine);
+        if(r.start == -1)
+            break;
+        result.push_back(r);
+        pos = r.end > r.start ? r.end : r.end + 1;
+    }
+    return result;
+}
+
+MatchResult find(const CompiledRegex &regex, const char *data, int len,
+                 MatchScratch &scratch, const MatchLimits &limits,
+                 EngineType engine)
+{
+    SearchBudget budget(limits);
+    MatchResult result;
+    result.range = findFrom(regex, data, len, 0, scratch, engine, &budget);
+    result.steps = budget.steps;
+    if(budget.exhausted())
+        result.status = budget.status;
+    else if(result.range.start != -1)
+        result.status = MATCH_FOUND;
+    else
+        result.status = MATCH_NOT_FOUND;
+    return result;
+}
+
+MatchResult find(const CompiledRegex &regex, string_view s,
+                 MatchScratch &scratch, const MatchLimits &limits,
+                 EngineType engine)
+{
+    checkLength(s, "find");
+    return find(regex, s.data(), s.length(), scratch, limits, engine);
+}
+
+MatchResult match(const CompiledRegex &regex, string_view s,
+                  MatchScratch &scratch, const MatchLimits &limits,
+                  EngineType engine)
+{
+    checkLength(s, "match");
+    SearchBudget budget(limits);
+    MatchResult result;
+    bool matched = matchFrom(regex, s.data(), s.length(), scratch, engine,
+                             &budget);
+    result.steps = budget.steps;
+    if(budget.exhausted())
+    {
+        result.status = budget.status;
+        result.range = Range(-1, -1);
+    }
+    else if(matched)
+    {
+        result.status = MATCH_FOUND;
+        result.range = Range(0, s.length());
+    }
+    else
+    {
+        result.status = MATCH_NOT_FOUND;
+        result.range = Range(-1, -1);
+    }
+    return result;
+}
+
+MatchIterator::MatchIterator(const CompiledRegex &regex, string_view s,
+                             MatchScratch &scratch, EngineType engine) :
+    regex(regex), s(s), scratch(scratch), engine(engine), pos(0)
+{
+    checkLength(s, "MatchIterator");
+}
+
+/* Finds the next match, storing it in r.  Returns false when there are no
+ * more matches.  The search resumes where the previous match ended, or one
+ * character later if that match was empty, so matches never overlap and an
+ * empty match is never reported twice.
+ */
+bool MatchIterator::next(Range &r)
+{
+    if(pos >= (long long) s.length())
+        return false;
+
+    r = findFrom(regex, s.data(), s.length(), pos, scratch, engine);
+    if(r.start == -1)
+    {
+        pos = s.length();
+        return false;
+    }
+
+    pos = r.end > r.start ? r.end : r.end + 1;
+    return true;
+}
+
+vector<Range> findAll(const CompiledRegex &regex, string_view s,
+                      MatchScratch &scratch, EngineType engine)
+{
+    vector<Range> result;
+    MatchIterator iter(regex, s, scratch, engine);
+    Range r;
+    while(iter.next(r))
+        result.push_back(r);
+    return result;
+}
+
+vector<Range> findAll(const vector<RegexOperator *> &regex, string_view s,
+                      EngineType engine)
+{
+    CompiledRegex compiled(regex);
+    MatchScratch scratch;
+    return findAll(compiled, s, scratch, engine);
+}
+
+Range find(const vector<RegexOperator *> &regex, string_view s,
+           EngineType engine)
+{
+    CompiledRegex compiled(regex);
+    MatchScratch scratch;
+    return find(compiled, s, scratch, engine);
+}
+
+bool match(const vector<RegexOperator *> &regex, string_view s,
+           EngineType engine)
+{
+    CompiledRegex compiled(regex);
+    MatchScratch scratch;
+    return match(compiled, s, scratch, engine);
+}
+
 // int main()
 // {
 //     string regex; 
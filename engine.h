@@ -1,6 +1,156 @@
-#include "./regex.h"
+#ifndef ENGINE_HH
+#define ENGINE_HH
 
+#include "./compiled.h"
 
-Range find(vector<RegexOperator *> regex, const string &s);
-bool match(vector<RegexOperator *> regex, const string &s);
- 
\ No newline at end of file
+#include <chrono>
+
+
+/* The matching algorithms that find() and match() can use.
+ *
+ *   ENGINE_BACKTRACK  the backtracking engine; fast on simple regexes, but
+ *                     can take exponential time on pathological ones.
+ *   ENGINE_BACKTRACK_MEMO
+ *                     the backtracking engine, remembering which states
+ *                     have failed so it never tries them twice.  Takes time
+ *                     polynomial in the length of the string, and one bit
+ *                     of scratch space per instruction and character; uses
+ *                     the Pike VM when that is over BACKTRACK_MEMO_BYTES.
+ *   ENGINE_PIKEVM     simulates the regex as a Thompson NFA, and always takes
+ *                     time linear in the length of the string.
+ *   ENGINE_DFA        runs a lazily built DFA.  Its states are cached in the
+ *                     MatchScratch, so searches with the same scratch reuse
+ *                     them.
+ *
+ * All engines return the same ranges.
+ */
+enum EngineType {
+    ENGINE_BACKTRACK,
+    ENGINE_BACKTRACK_MEMO,
+    ENGINE_PIKEVM,
+    ENGINE_DFA
+};
+
+// The string is searched in place, so a string, a string_view slice of a
+// bigger buffer and a string literal are never copied.  Ranges are int
+// offsets, so a string longer than INT_MAX bytes throws length_error; use
+// findLong() for those.
+Range find(const CompiledRegex &regex, string_view s, MatchScratch &scratch,
+           EngineType engine = ENGINE_BACKTRACK);
+
+// Returns true if the whole string matches.  Only index 0 is tried, and the
+// engines backtrack from matches that end before the end of the string.
+// Strings longer than an int can index are matched by the Pike VM.
+bool match(const CompiledRegex &regex, string_view s, MatchScratch &scratch,
+           EngineType engine = ENGINE_BACKTRACK);
+
+// Searches data[0, len) in place, such as a buffer that is not a string or a
+// memory-mapped file, without copying it.
+Range find(const CompiledRegex &regex, const char *data, int len,
+           MatchScratch &scratch, EngineType engine = ENGINE_BACKTRACK);
+bool match(const CompiledRegex &regex, const char *data, int len,
+           MatchScratch &scratch, EngineType engine = ENGINE_BACKTRACK);
+
+// Like find(), for strings of any length, such as a memory-mapped file of
+// more than 2 GB, with 64-bit offsets.  Strings an int can index are
+// searched by "engine", and longer ones by the Pike VM, which keeps 64-bit
+// offsets throughout.
+LongRange findLong(const CompiledRegex &regex, string_view s,
+                   MatchScratch &scratch,
+                   EngineType engine = ENGINE_BACKTRACK);
+
+// Like findAll(), for strings of any length, with 64-bit offsets.
+vector<LongRange> findAllLong(const CompiledRegex &regex, string_view s,
+                              MatchScratch &scratch,
+                              EngineType engine = ENGINE_BACKTRACK);
+
+
+/* Limits on how much work one search may do, for regexes that cannot be
+ * trusted to run quickly.  A step is one application of an operator by the
+ * backtracking engines, so a regex that backtracks heavily uses up its
+ * steps long before it has read much of the string.  The Pike VM and the
+ * DFA always take time linear in the length of the string; they ignore the
+ * limits and report no steps.
+ */
+struct MatchLimits {
+    // The most steps a search may take, or 0 for no limit.
+    long long maxSteps;
+
+    // How long a search may run for, or 0 for no limit.  The clock is only
+    // read every MATCH_CLOCK_STEPS steps.
+    chrono::nanoseconds timeout;
+
+    explicit MatchLimits(long long maxSteps = 0,
+                         chrono::nanoseconds timeout = chrono::nanoseconds(0))
+        : maxSteps(maxSteps), timeout(timeout) { }
+};
+
+const int MATCH_CLOCK_STEPS = 256;
+
+
+/* How a search with limits ended.  Unless it is MATCH_FOUND, the range is
+ * (-1, -1); after MATCH_STEP_LIMIT or MATCH_TIMEOUT the string may still
+ * contain a match, which a linear time engine such as ENGINE_PIKEVM can
+ * find.
+ */
+enum MatchStatus {
+    MATCH_FOUND,
+    MATCH_NOT_FOUND,
+    MATCH_STEP_LIMIT,
+    MATCH_TIMEOUT
+};
+
+struct MatchResult {
+    MatchStatus status;
+    Range range;
+
+    // The number of steps the search took.
+    long long steps;
+};
+
+MatchResult find(const CompiledRegex &regex, string_view s,
+                 MatchScratch &scratch, const MatchLimits &limits,
+                 EngineType engine = ENGINE_BACKTRACK);
+MatchResult find(const CompiledRegex &regex, const char *data, int len,
+                 MatchScratch &scratch, const MatchLimits &limits,
+                 EngineType engine = ENGINE_BACKTRACK);
+MatchResult match(const CompiledRegex &regex, string_view s,
+                  MatchScratch &scratch, const MatchLimits &limits,
+                  EngineType engine = ENGINE_BACKTRACK);
+
+
+/* Steps through the non-overlapping matches of a regex in a string, from
+ * left to right, reusing the same scratch space for the whole pass.  Like
+ * find(), matches only start at indexes inside the string.  The regex,
+ * string and scratch must outlive the iterator.  A string longer than
+ * INT_MAX bytes throws length_error; findAllLong() takes those.
+ */
+class MatchIterator {
+    const CompiledRegex &regex;
+    string_view s;
+    MatchScratch &scratch;
+    EngineType engine;
+
+    // The index the next search starts at.
+    int pos;
+
+public:
+    MatchIterator(const CompiledRegex &regex, string_view s,
+                  MatchScratch &scratch, EngineType engine = ENGINE_BACKTRACK);
+
+    bool next(Range &r);
+};
+
+vector<Range> findAll(const CompiledRegex &regex, string_view s,
+                      MatchScratch &scratch,
+                      EngineType engine = ENGINE_BACKTRACK);
+
+// These compile the regex and allocate scratch space on every call.
+Range find(const vector<RegexOperator *> &regex, string_view s,
+           EngineType engine = ENGINE_BACKTRACK);
+bool match(const vector<RegexOperator *> &regex, string_view s,
+           EngineType engine = ENGINE_BACKTRACK);
+vector<Range> findAll(const vector<RegexOperator *> &regex, string_view s,
+                      EngineType engine = ENGINE_BACKTRACK);
+
+#endif // ENGINE_HH
@@ -0,0 +1,81 @@
+#include "instrument.h"
+
+#include <string>
+
+
+SearchCounters &SearchCounters::operator+=(const SearchCounters &other) {
+    searches += other.searches;
+    startsTried += other.startsTried;
+    operatorsApplied += other.operatorsApplied;
+    backtracks += other.backtracks;
+    bytesScanned += other.bytesScanned;
+    return *this;
+}
+
+
+void StreamTracer::onStart(const char *data, int len, int start) {
+    out << string(78, '-') << endl;
+    out << "Find regex in \"" << string(data, len)
+        << "\", starting at index " << start << endl;
+}
+
+
+void StreamTracer::onApply(int op, int pos, int count, bool success) {
+    out << "Applied operator " << op << " at index " << pos << ": matched "
+        << count << " character(s)" << (success ? "" : ", failed") << endl;
+}
+
+
+void StreamTracer::onGiveBack(int op, int pos) {
+    out << " * Operator " << op << " gives back a character; retrying from "
+        << "index " << pos << endl;
+}
+
+
+void StreamTracer::onUnapply(int op) {
+    out << " * Un-applying operator " << op << endl;
+}
+
+
+void StreamTracer::onEnd(Range r) {
+    if (r.start == -1)
+        out << "Match failed, giving up" << endl;
+    else
+        out << "Match succeeded on range [" << r.start << ", " << r.end
+            << ")" << endl;
+}
+
+
+PatternStats::PatternStats() :
+    searches(0), startsTried(0), operatorsApplied(0), backtracks(0),
+    bytesScanned(0) { }
+
+
+void PatternStats::add(const SearchCounters &counters) {
+    searches.fetch_add(counters.searches, memory_order_relaxed);
+    startsTried.fetch_add(counters.startsTried, memory_order_relaxed);
+    operatorsApplied.fetch_add(counters.operatorsApplied,
+                               memory_order_relaxed);
+    backtracks.fetch_add(counters.backtracks, memory_order_relaxed);
+    bytesScanned.fetch_add(counters.bytesScanned, memory_order_relaxed);
+}
+
+
+SearchCounters PatternStats::get() const {
+    SearchCounters counters;
+    counters.searches = searches.load(memory_order_relaxed);
+    counters.startsTried = startsTried.load(memory_order_relaxed);
+    counters.operatorsApplied = operatorsApplied.load(memory_order_relaxed);
+    counters.backtracks = backtracks.load(memory_order_relaxed);
+    counters.bytesScanned = bytesScanned.load(memory_order_relaxed);
+    return counters;
+}
+
+
+void PatternStats::reset() {
+    searches = 0;
+    startsTried = 0;
+    operatorsApplied = 0;
+    backtracks = 0;
+    bytesScanned = 0;
+}
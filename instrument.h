@@ -0,0 +1,102 @@
+#ifndef INSTRUMENT_HH
+#define INSTRUMENT_HH
+
+#include "./regex.h"
+
+#include <atomic>
+#include <ostream>
+
+
+/* Counters that describe the work of searches.  Apart from "searches", they
+ * only count the work of the backtracking engines; the Pike VM and the DFA
+ * take time linear in the length of the string whatever the regex.
+ */
+struct SearchCounters {
+    // Calls to find() or match(), including one per match of findAll().
+    long long searches;
+
+    // Start indexes the backtracking engine tried a match at.
+    long long startsTried;
+
+    // Times an operator was applied to the input.
+    long long operatorsApplied;
+
+    // Times an operator gave back a character, or was un-applied, to let a
+    // later operator match.
+    long long backtracks;
+
+    // Characters matched by operators, counting a character again each time
+    // it is matched again after backtracking.
+    long long bytesScanned;
+
+    SearchCounters() : searches(0), startsTried(0), operatorsApplied(0),
+        backtracks(0), bytesScanned(0) { }
+
+    SearchCounters &operator+=(const SearchCounters &other);
+};
+
+
+/* Receives every step of the backtracking engine, for debugging a regex or
+ * finding out why it is slow.  Subclasses override the events they need;
+ * the others do nothing.
+ */
+class SearchTracer {
+public:
+    virtual ~SearchTracer() { }
+
+    // A match is attempted starting at index "start" of the input.
+    virtual void onStart(const char *data, int len, int start) { }
+
+    // Operator "op" was applied at index "pos" and matched "count"
+    // characters; "success" is false if that was fewer than it needs, or if
+    // the state was already known to fail.
+    virtual void onApply(int op, int pos, int count, bool success) { }
+
+    // Operator "op" gave back its last character; the next operator is
+    // retried from index "pos".
+    virtual void onGiveBack(int op, int pos) { }
+
+    // Operator "op" was un-applied, since it cannot give back any more.
+    virtual void onUnapply(int op) { }
+
+    // The attempt ended with the range r, or (-1, -1) if it failed.
+    virtual void onEnd(Range r) { }
+};
+
+
+/* A tracer that writes every step to a stream, in words. */
+class StreamTracer : public SearchTracer {
+    ostream &out;
+
+public:
+    explicit StreamTracer(ostream &out) : out(out) { }
+
+    void onStart(const char *data, int len, int start);
+    void onApply(int op, int pos, int count, bool success);
+    void onGiveBack(int op, int pos);
+    void onUnapply(int op);
+    void onEnd(Range r);
+};
+
+
+/* The counters of every search made with one regex, added up.  Searches
+ * only add to them if they count their work, and each search adds its
+ * counters once, when it ends.  The counters are atomic, so any number of
+ * threads sharing the regex can add to them.
+ */
+class PatternStats {
+    atomic<long long> searches;
+    atomic<long long> startsTried;
+    atomic<long long> operatorsApplied;
+    atomic<long long> backtracks;
+    atomic<long long> bytesScanned;
+
+public:
+    PatternStats();
+
+    void add(const SearchCounters &counters);
+    SearchCounters get() const;
+    void reset();
+};
+
+#endif // INSTRUMENT_HH
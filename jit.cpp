@@ -0,0 +1,473 @@
+#include "jit.h"
+
+#include <cstddef>
+#include <cstring>
+
+#if defined(__x86_64__) && defined(__linux__)
+#define HAVE_JIT 1
+#include <sys/mman.h>
+#else
+#define HAVE_JIT 0
+#endif
+
+
+#if HAVE_JIT
+
+// The general purpose registers, by their number in the encoding.
+enum Reg {
+    RAX = 0, RCX = 1, RDX = 2, RBX = 3, RSP = 4, RBP = 5, RSI = 6, RDI = 7,
+    R8 = 8, R9 = 9, R10 = 10, R11 = 11
+};
+
+// The condition codes of jcc.
+enum Cond {
+    CC_B = 0x2, CC_AE = 0x3, CC_E = 0x4, CC_NE = 0x5, CC_BE = 0x6,
+    CC_A = 0x7, CC_LE = 0xE
+};
+
+
+/* Emits the handful of x86-64 instructions the JIT needs, with jumps to
+ * labels that may not be bound yet; their offsets are patched in finish().
+ */
+class Assembler {
+    struct Fixup {
+        int at;
+        int label;
+    };
+
+    vector<int> labels;
+    vector<Fixup> fixups;
+
+public:
+    vector<uint8_t> code;
+
+    int newLabel() {
+        labels.push_back(-1);
+        return labels.size() - 1;
+    }
+
+    void bind(int label) {
+        labels[label] = code.size();
+    }
+
+    void byte(uint8_t b) {
+        code.push_back(b);
+    }
+
+    void imm32(int32_t v) {
+        for (int i = 0; i < 4; i++)
+            byte((uint32_t) v >> (8 * i));
+    }
+
+    // A 32-bit offset to a label, from the end of the instruction.
+    void rel32(int label) {
+        Fixup fixup = { (int) code.size(), label };
+        fixups.push_back(fixup);
+        imm32(0);
+    }
+
+    void rexW(int reg, int rm) {
+        byte(0x48 | (reg & 8 ? 4 : 0) | (rm & 8 ? 1 : 0));
+    }
+
+    void modrm(int reg, int rm) {
+        byte(0xC0 | (reg & 7) << 3 | (rm & 7));
+    }
+
+    void movRR(Reg dst, Reg src) {
+        rexW(src, dst);
+        byte(0x89);
+        modrm(src, dst);
+    }
+
+    void addRR(Reg dst, Reg src) {
+        rexW(src, dst);
+        byte(0x01);
+        modrm(src, dst);
+    }
+
+    void subRR(Reg dst, Reg src) {
+        rexW(src, dst);
+        byte(0x29);
+        modrm(src, dst);
+    }
+
+    // Sets the flags for a - b.
+    void cmpRR(Reg a, Reg b) {
+        rexW(b, a);
+        byte(0x39);
+        modrm(b, a);
+    }
+
+    void cmpRI(Reg r, int32_t imm) {
+        rexW(0, r);
+        byte(0x81);
+        modrm(7, r);
+        imm32(imm);
+    }
+
+    void movRI(Reg r, int32_t imm) {
+        rexW(0, r);
+        byte(0xC7);
+        modrm(0, r);
+        imm32(imm);
+    }
+
+    void incR(Reg r) {
+        rexW(0, r);
+        byte(0xFF);
+        modrm(0, r);
+    }
+
+    void decR(Reg r) {
+        rexW(0, r);
+        byte(0xFF);
+        modrm(1, r);
+    }
+
+    // mov dword [r9 + disp], src
+    void store(int32_t disp, Reg src) {
+        byte(0x41 | (src & 8 ? 4 : 0));
+        byte(0x89);
+        byte(0x80 | (src & 7) << 3 | (R9 & 7));
+        imm32(disp);
+    }
+
+    // mov dst, dword [r9 + disp], which clears the upper half of dst
+    void load(Reg dst, int32_t disp) {
+        byte(0x41 | (dst & 8 ? 4 : 0));
+        byte(0x8B);
+        byte(0x80 | (dst & 7) << 3 | (R9 & 7));
+        imm32(disp);
+    }
+
+    void jcc(Cond cc, int label) {
+        byte(0x0F);
+        byte(0x80 | cc);
+        rel32(label);
+    }
+
+    void jmp(int label) {
+        byte(0xE9);
+        rel32(label);
+    }
+
+    void ret() {
+        byte(0xC3);
+    }
+
+    // Patches the jumps; returns false if a label was never bound.
+    bool finish() {
+        for (size_t i = 0; i < fixups.size(); i++) {
+            int target = labels[fixups[i].label];
+            if (target == -1)
+                return false;
+            int32_t rel = target - (fixups[i].at + 4);
+            memcpy(&code[fixups[i].at], &rel, 4);
+        }
+        return true;
+    }
+};
+
+
+/* How the code tests a character against an instruction's class. */
+enum TestKind {
+    TEST_NONE,       // no character
+    TEST_ANY,        // every character
+    TEST_CHAR,       // one character: lo
+    TEST_RANGE,      // the characters from lo to hi
+    TEST_NOT_RANGE,  // every character but those from lo to hi
+    TEST_BITMAP      // a bit test in the class's bitmap
+};
+
+struct CharTest {
+    TestKind kind;
+    int lo, hi;
+};
+
+
+/* Returns the lowest and highest characters of the class in lo and hi, and
+ * true if it holds every character in between.
+ */
+static bool contiguous(const CharClass &cls, bool member, int &lo, int &hi) {
+    lo = -1;
+    for (int c = 0; c < 256; c++) {
+        if (cls.contains(c) == member) {
+            if (lo == -1)
+                lo = c;
+            hi = c;
+        }
+    }
+    if (lo == -1)
+        return false;
+    for (int c = lo; c <= hi; c++) {
+        if (cls.contains(c) != member)
+            return false;
+    }
+    return true;
+}
+
+
+static CharTest pickTest(const Program &prog, const Inst &inst) {
+    CharTest test = { TEST_BITMAP, 0, 0 };
+    if (inst.opcode == OP_ANY) {
+        test.kind = TEST_ANY;
+        return test;
+    }
+    if (inst.opcode == OP_CHAR) {
+        test.kind = TEST_CHAR;
+        test.lo = test.hi = inst.arg;
+        return test;
+    }
+
+    const CharClass &cls = prog.getClass(inst.arg);
+    if (cls.count() == 0)
+        test.kind = TEST_NONE;
+    else if (contiguous(cls, true, test.lo, test.hi))
+        test.kind = TEST_RANGE;
+    else if (contiguous(cls, false, test.lo, test.hi))
+        test.kind = TEST_NOT_RANGE;
+    return test;
+}
+
+
+/* Emits the test of the character in eax; jumps to "miss" if it is not in
+ * the class.  For TEST_BITMAP, r10 points to the bitmap.
+ */
+static void emitTest(Assembler &as, const CharTest &test, int miss) {
+    switch (test.kind) {
+    case TEST_CHAR:
+        as.byte(0x3C);              // cmp al, lo
+        as.byte(test.lo);
+        as.jcc(CC_NE, miss);
+        break;
+    case TEST_RANGE:
+    case TEST_NOT_RANGE:
+        as.byte(0x2D);              // sub eax, lo
+        as.imm32(test.lo);
+        as.byte(0x3D);              // cmp eax, hi - lo
+        as.imm32(test.hi - test.lo);
+        as.jcc(test.kind == TEST_RANGE ? CC_A : CC_BE, miss);
+        break;
+    default:
+        as.byte(0x41);              // bt [r10], eax
+        as.byte(0x0F);
+        as.byte(0xA3);
+        as.byte(0x02);
+        as.jcc(CC_AE, miss);
+        break;
+    }
+}
+
+
+/* Emits the step of a run: loads the character at r11 + rcx into eax,
+ * tests it, and counts it in rcx.
+ */
+static void emitStep(Assembler &as, const CharTest &test, int done) {
+    as.byte(0x41);                  // movzx eax, byte [r11 + rcx]
+    as.byte(0x0F);
+    as.byte(0xB6);
+    as.byte(0x04);
+    as.byte(0x0B);
+    emitTest(as, test, done);
+    as.incR(RCX);
+}
+
+
+/* Emits a function
+ *
+ *     long match(const unsigned char *data, long len, long start,
+ *                RunState *runs)
+ *
+ * that returns where the program's match at "start" ends, or -1.  data is
+ * in rdi, len in rsi, the current index in rdx and runs in r9.  Operator i
+ * keeps the index it started at and the length of its run in runs[i].
+ */
+static void emitMatcher(Assembler &as, const Program &prog, bool anchorEnd,
+                        const vector<int> &bitmaps) {
+    int n = prog.size();
+    const int runBytes = sizeof(RunState);
+
+    vector<int> enter(n + 1), retry(n);
+    for (int i = 0; i <= n; i++)
+        enter[i] = as.newLabel();
+    for (int i = 0; i < n; i++)
+        retry[i] = as.newLabel();
+    int fail = as.newLabel();
+
+    // rcx holds the runs on entry, but counts the length of each run.
+    as.movRR(R9, RCX);
+
+    for (int i = 0; i < n; i++) {
+        const Inst &inst = prog[i];
+        CharTest test = pickTest(prog, inst);
+        int failed = i == 0 ? fail : retry[i - 1];
+
+        as.bind(enter[i]);
+        as.store(runBytes * i + offsetof(RunState, start), RDX);
+
+        // r8 = how many characters the run may take.
+        as.movRR(R8, RSI);
+        as.subRR(R8, RDX);
+        if (inst.maxRepeat != -1) {
+            int clamped = as.newLabel();
+            as.cmpRI(R8, inst.maxRepeat);
+            as.jcc(CC_LE, clamped);
+            as.movRI(R8, inst.maxRepeat);
+            as.bind(clamped);
+        }
+
+        // rcx = the length of the run.
+        if (test.kind == TEST_ANY)
+            as.movRR(RCX, R8);
+        else if (test.kind == TEST_NONE)
+            as.movRI(RCX, 0);
+        else {
+            as.byte(0x4C);          // lea r11, [rdi + rdx]
+            as.byte(0x8D);
+            as.byte(0x1C);
+            as.byte(0x17);
+            if (test.kind == TEST_BITMAP) {
+                as.byte(0x4C);      // lea r10, [rip + bitmap]
+                as.byte(0x8D);
+                as.byte(0x15);
+                as.rel32(bitmaps[inst.arg]);
+            }
+            as.movRI(RCX, 0);
+
+            int done = as.newLabel();
+            int single = as.newLabel();
+            if (inst.maxRepeat == -1 || inst.maxRepeat >= 8) {
+                // Four characters at a time while four are left.
+                int unrolled = as.newLabel();
+                as.bind(unrolled);
+                as.byte(0x48);      // lea rax, [rcx + 4]
+                as.byte(0x8D);
+                as.byte(0x41);
+                as.byte(0x04);
+                as.cmpRR(RAX, R8);
+                as.jcc(CC_A, single);
+                for (int k = 0; k < 4; k++)
+                    emitStep(as, test, done);
+                as.jmp(unrolled);
+            }
+            as.bind(single);
+            as.cmpRR(RCX, R8);
+            as.jcc(CC_AE, done);
+            emitStep(as, test, done);
+            as.jmp(single);
+            as.bind(done);
+        }
+
+        as.cmpRI(RCX, inst.minRepeat);
+        as.jcc(CC_B, failed);
+        as.store(runBytes * i + offsetof(RunState, count), RCX);
+        as.addRR(RDX, RCX);
+    }
+
+    as.bind(enter[n]);
+    if (anchorEnd) {
+        as.cmpRR(RDX, RSI);
+        as.jcc(CC_NE, n == 0 ? fail : retry[n - 1]);
+    }
+    as.movRR(RAX, RDX);
+    as.ret();
+
+    // Operator i gives back one character of its run, and the operators
+    // after it are tried again; without one to give back, or if it is
+    // possessive, operator i - 1 has to.
+    for (int i = n - 1; i >= 0; i--) {
+        const Inst &inst = prog[i];
+        int failed = i == 0 ? fail : retry[i - 1];
+
+        as.bind(retry[i]);
+        if (inst.minRepeat == inst.maxRepeat ||
+            (inst.flags & INST_POSSESSIVE)) {
+            as.jmp(failed);
+            continue;
+        }
+        as.load(RCX, runBytes * i + offsetof(RunState, count));
+        as.cmpRI(RCX, inst.minRepeat);
+        as.jcc(CC_BE, failed);
+        as.decR(RCX);
+        as.store(runBytes * i + offsetof(RunState, count), RCX);
+        as.load(RDX, runBytes * i + offsetof(RunState, start));
+        as.addRR(RDX, RCX);
+        as.jmp(enter[i + 1]);
+    }
+
+    as.bind(fail);
+    as.movRI(RAX, -1);
+    as.ret();
+}
+
+#endif // HAVE_JIT
+
+
+JitProgram::JitProgram(const Program &prog) :
+    code(NULL), codeBytes(0), unanchored(NULL), anchored(NULL) {
+#if HAVE_JIT
+    Assembler as;
+    vector<int> bitmaps;
+    for (int i = 0; i < prog.getNumClasses(); i++)
+        bitmaps.push_back(as.newLabel());
+
+    emitMatcher(as, prog, false, bitmaps);
+    size_t anchoredAt = as.code.size();
+    emitMatcher(as, prog, true, bitmaps);
+
+    // The classes' bitmaps follow the code.
+    while (as.code.size() % 32 != 0)
+        as.byte(0xCC);
+    for (int i = 0; i < prog.getNumClasses(); i++) {
+        as.bind(bitmaps[i]);
+        for (int c = 0; c < 256; c += 8) {
+            uint8_t bits = 0;
+            for (int k = 0; k < 8; k++) {
+                if (prog.getClass(i).contains(c + k))
+                    bits |= 1 << k;
+            }
+            as.byte(bits);
+        }
+    }
+    if (!as.finish())
+        return;
+
+    // Written while writable, then made executable and read-only.
+    size_t bytes = as.code.size();
+    void *mapped = mmap(NULL, bytes, PROT_READ | PROT_WRITE,
+                        MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (mapped == MAP_FAILED)
+        return;
+    memcpy(mapped, as.code.data(), bytes);
+    if (mprotect(mapped, bytes, PROT_READ | PROT_EXEC) != 0) {
+        munmap(mapped, bytes);
+        return;
+    }
+
+    code = mapped;
+    codeBytes = bytes;
+    unanchored = (MatchFn) code;
+    anchored = (MatchFn) ((char *) code + anchoredAt);
+#else
+    (void) prog;
+#endif
+}
+
+
+JitProgram::~JitProgram() {
+#if HAVE_JIT
+    if (code != NULL)
+        munmap(code, codeBytes);
+#endif
+}
+
+
+bool JitProgram::isSupported() {
+    return HAVE_JIT;
+}
+
+
+bool JitProgram::ok() const {
+    return code != NULL;
+}
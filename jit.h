@@ -0,0 +1,59 @@
+#ifndef JIT_HH
+#define JIT_HH
+
+#include "./program.h"
+
+
+// The number of backtracking searches with a CompiledRegex after which it
+// compiles its program to machine code.
+const long long JIT_THRESHOLD_CALLS = 1000;
+
+
+/* A program compiled to x86-64 machine code, in a region of memory mapped
+ * executable.  Only available on Linux x86-64; elsewhere ok() is false and
+ * the engines keep interpreting the program.
+ *
+ * The code does what findAtIndex() does, in the same order: each operator
+ * takes its longest run, and gives back one character at a time when a
+ * later operator fails.  The run of each operator is a loop unrolled four
+ * times, testing a character with one compare for a single character, two
+ * for a range such as \d or everything outside one such as [^,], and a bit
+ * test in a 256-bit bitmap for other classes.  The start of each operator
+ * and the length of its run, all the state backtracking needs, are kept in
+ * the caller's RunState array, so the code uses no more native stack for a
+ * long pattern than for a short one.
+ */
+class JitProgram {
+    typedef long (*MatchFn)(const unsigned char *data, long len, long start,
+                            RunState *runs);
+
+    void *code;
+    size_t codeBytes;
+    MatchFn unanchored;
+    MatchFn anchored;
+
+public:
+    explicit JitProgram(const Program &prog);
+    ~JitProgram();
+
+    JitProgram(const JitProgram &) = delete;
+    JitProgram &operator=(const JitProgram &) = delete;
+
+    // Returns true if this platform has a JIT.
+    static bool isSupported();
+
+    // Returns true if the program was compiled.
+    bool ok() const;
+
+    // Matches the program at index "start", like findAtIndex().  Returns
+    // where the match ends, or -1 if there is none.  With anchorEnd, only
+    // a match that ends at the end of the input will do.  "runs" must hold
+    // one RunState per instruction.
+    int matchAt(const char *data, int len, int start, bool anchorEnd,
+                RunState *runs) const {
+        MatchFn fn = anchorEnd ? anchored : unanchored;
+        return fn((const unsigned char *) data, len, start, runs);
+    }
+};
+
+#endif // JIT_HH
@@ -0,0 +1,222 @@
+#include "nfa.h"
+
+
+/* Appends an instruction to the program and returns its index. */
+static int emit(NFAProgram &prog, NFAOpcode opcode, int cls, int x, int y) {
+    NFAInst inst;
+    inst.opcode = opcode;
+    inst.cls = cls;
+    inst.x = x;
+    inst.y = y;
+    prog.insts.push_back(inst);
+    return (int) prog.insts.size() - 1;
+}
+
+
+/* Compiles the flat program into a Thompson NFA.  Every instruction is
+ * expanded according to its repeat counts:
+ *
+ *   x{2,4}  ->  BYTE x; BYTE x; SPLIT(L1, end); L1: BYTE x; SPLIT(L2, end);
+ *               L2: BYTE x; end:
+ *   x*      ->  L0: SPLIT(L1, end); L1: BYTE x; JMP L0; end:
+ *
+ * The higher-priority branch of every SPLIT is the one that consumes more
+ * input, so the Pike VM prefers exactly the matches the greedy backtracking
+ * engine prefers.
+ *
+ * If "reversed" is true, the instructions are compiled last to first.  Every
+ * instruction consumes exactly one character, so the reversed NFA matches
+ * the reversed strings.
+ */
+NFAProgram compileNFA(const Program &program, bool reversed,
+                      pmr::memory_resource *resource) {
+    NFAProgram prog(resource);
+
+    for (int i = 0; i < program.size(); i++) {
+        const Inst &op = program[reversed ? program.size() - 1 - i : i];
+        int minRepeat = op.minRepeat;
+        int maxRepeat = op.maxRepeat;
+        int cls = prog.classes.size();
+        prog.classes.push_back(program.classOf(op));
+
+        for (int n = 0; n < minRepeat; n++) {
+            int pc = (int) prog.insts.size();
+            emit(prog, NFA_BYTE, cls, pc + 1, -1);
+        }
+
+        if (maxRepeat == -1) {
+            int loop = (int) prog.insts.size();
+            emit(prog, NFA_SPLIT, -1, loop + 1, loop + 3);
+            emit(prog, NFA_BYTE, cls, loop + 2, -1);
+            emit(prog, NFA_JMP, -1, loop, -1);
+        }
+        else if (maxRepeat > minRepeat) {
+            // Each optional copy skips straight past the last one, so the
+            // exit target is only known once all of them are emitted.
+            pmr::vector<int> splits(resource);
+            for (int n = minRepeat; n < maxRepeat; n++) {
+                int pc = (int) prog.insts.size();
+                splits.push_back(emit(prog, NFA_SPLIT, -1, pc + 1, -1));
+                emit(prog, NFA_BYTE, cls, pc + 2, -1);
+            }
+            int end = (int) prog.insts.size();
+            for (size_t n = 0; n < splits.size(); n++)
+                prog.insts[splits[n]].y = end;
+        }
+    }
+
+    emit(prog, NFA_MATCH, -1, -1, -1);
+    prog.start = 0;
+    return prog;
+}
+
+
+NFAProgram compileNFA(const vector<RegexOperator *> &regex) {
+    return compileNFA(compileProgram(regex));
+}
+
+
+/* Adds the thread at "pc" to the list, following NFA_SPLIT and NFA_JMP
+ * instructions in priority order.  An instruction already in the list was
+ * reached by a higher-priority thread, so it is not added again.
+ */
+void addThread(const NFAProgram &prog, ThreadList &list, vector<int> &stack,
+               int pc, long long start) {
+    stack.clear();
+    stack.push_back(pc);
+
+    while (!stack.empty()) {
+        pc = stack.back();
+        stack.pop_back();
+
+        if (list.contains(pc))
+            continue;
+        list.add(pc, start);
+
+        const NFAInst &inst = prog.insts[pc];
+        if (inst.opcode == NFA_JMP) {
+            stack.push_back(inst.x);
+        }
+        else if (inst.opcode == NFA_SPLIT) {
+            // Push the lower-priority branch first so it is followed last.
+            stack.push_back(inst.y);
+            stack.push_back(inst.x);
+        }
+    }
+}
+
+
+/* Runs the Pike VM over the string, simulating every thread of the NFA in
+ * lockstep.  Threads are kept in priority order, and a new thread is started
+ * at every index (with the lowest priority) until a match is found, so the
+ * result is the leftmost match that the backtracking engine would choose.
+ * The running time is O(len * insts) regardless of the regex and input.
+ *
+ * Like find(), match attempts only start at indexes inside the string, and
+ * not before "from".
+ *
+ * If there is no match, returns the range (-1, -1).
+ */
+LongRange pikeFindLong(const NFAProgram &prog, const char *data,
+                       long long len, PikeScratch &scratch, long long from,
+                       const CharClass *first) {
+    int numInsts = prog.insts.size();
+
+    ThreadList &clist = scratch.clist;
+    ThreadList &nlist = scratch.nlist;
+    vector<int> &stack = scratch.stack;
+    clist.reserve(numInsts);
+    nlist.reserve(numInsts);
+    LongRange matched(-1, -1);
+
+    for (long long i = from; i <= len; i++) {
+        if (first != NULL && matched.start == -1 && clist.count() == 0) {
+            while (i < len && !first->contains(data[i]))
+                i++;
+        }
+
+        if (matched.start == -1 && i < len)
+            addThread(prog, clist, stack, prog.start, i);
+
+        if (clist.count() == 0)
+            break;
+
+        for (int t = 0; t < clist.count(); t++) {
+            const NFAInst &inst = prog.insts[clist.pc(t)];
+
+            if (inst.opcode == NFA_BYTE) {
+                if (i < len && prog.classes[inst.cls].contains(data[i]))
+                    addThread(prog, nlist, stack, inst.x, clist.start(t));
+            }
+            else if (inst.opcode == NFA_MATCH) {
+                // Every thread after this one has a lower priority than the
+                // match, so they can all be cut off.
+                matched.start = clist.start(t);
+                matched.end = i;
+                break;
+            }
+        }
+
+        swap(clist, nlist);
+        nlist.clear();
+    }
+
+    return matched;
+}
+
+
+Range pikeFind(const NFAProgram &prog, const char *data, int len,
+               PikeScratch &scratch, int from) {
+    LongRange r = pikeFindLong(prog, data, len, scratch, from);
+    return Range(r.start, r.end);
+}
+
+
+/* Like pikeFind(), but only starts a thread at index 0, and only accepts a
+ * match at the end of the input.  Any thread that reaches the end in a
+ * matching state will do, so unlike a search it has to run to the end.
+ */
+bool pikeMatch(const NFAProgram &prog, const char *data, long long len,
+               PikeScratch &scratch) {
+    int numInsts = prog.insts.size();
+
+    ThreadList &clist = scratch.clist;
+    ThreadList &nlist = scratch.nlist;
+    vector<int> &stack = scratch.stack;
+    clist.reserve(numInsts);
+    nlist.reserve(numInsts);
+    clist.clear();
+    addThread(prog, clist, stack, prog.start, 0);
+
+    for (long long i = 0; i < len && clist.count() > 0; i++) {
+        for (int t = 0; t < clist.count(); t++) {
+            const NFAInst &inst = prog.insts[clist.pc(t)];
+            if (inst.opcode == NFA_BYTE &&
+                prog.classes[inst.cls].contains(data[i]))
+                addThread(prog, nlist, stack, inst.x, 0);
+        }
+
+        swap(clist, nlist);
+        nlist.clear();
+    }
+
+    bool matched = false;
+    for (int t = 0; t < clist.count(); t++) {
+        if (prog.insts[clist.pc(t)].opcode == NFA_MATCH)
+            matched = true;
+    }
+    clist.clear();
+    return matched;
+}
+
+
+Range pikeFind(const NFAProgram &prog, const string &s, PikeScratch &scratch,
+               int from) {
+    return pikeFind(prog, s.data(), s.length(), scratch, from);
+}
+
+
+Range pikeFind(const NFAProgram &prog, const string &s) {
+    PikeScratch scratch;
+    return pikeFind(prog, s, scratch);
+}
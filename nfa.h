@@ -0,0 +1,146 @@
+#ifndef NFA_HH
+#define NFA_HH
+
+#include "./program.h"
+
+
+/* The instructions of a Thompson NFA.  A parsed regex is compiled into a
+ * flat list of these instructions, which is then simulated by the Pike VM.
+ *
+ *   NFA_BYTE   consumes one input character if it is in class number "cls",
+ *              and continues at "x".
+ *   NFA_SPLIT  continues at both "x" and "y"; "x" has the higher priority.
+ *   NFA_JMP    continues at "x".
+ *   NFA_MATCH  the regex has matched.
+ */
+enum NFAOpcode {
+    NFA_BYTE,
+    NFA_SPLIT,
+    NFA_JMP,
+    NFA_MATCH
+};
+
+struct NFAInst {
+    NFAOpcode opcode;
+
+    // The class that the input character is tested against, for NFA_BYTE.
+    int cls;
+
+    // The instruction(s) to continue at.
+    int x, y;
+};
+
+
+/* A compiled Thompson NFA.  Every instruction of the flat program it was
+ * compiled from gets an entry in "classes", whatever its opcode.
+ */
+class NFAProgram {
+public:
+    pmr::vector<NFAInst> insts;
+    pmr::vector<CharClass> classes;
+
+    // The index of the first instruction to run.
+    int start;
+
+    explicit NFAProgram(pmr::memory_resource *resource =
+                            pmr::get_default_resource()) :
+        insts(resource), classes(resource) {
+        start = 0;
+    }
+};
+
+
+/* An ordered list of threads, each one an instruction to run together with
+ * the index where its match attempt started.  Starts are 64-bit so that a
+ * list can also follow matches through a stream.  The "sparse" array makes
+ * both membership tests and clearing O(1), so each step of the Pike VM costs
+ * time proportional to the number of live threads only.
+ */
+class ThreadList {
+    vector<int> sparse;
+    vector<int> densePc;
+    vector<long long> denseStart;
+    int size;
+
+public:
+    ThreadList() : size(0) { }
+
+    // Makes room for the instructions of a program, keeping the memory
+    // already allocated if it is big enough.
+    void reserve(int numInsts) {
+        if ((int) sparse.size() < numInsts) {
+            sparse.resize(numInsts);
+            densePc.resize(numInsts);
+            denseStart.resize(numInsts);
+        }
+        size = 0;
+    }
+
+    bool contains(int pc) const {
+        int i = sparse[pc];
+        return i < size && densePc[i] == pc;
+    }
+
+    // Marks the instruction as visited.  Only NFA_BYTE and NFA_MATCH
+    // instructions become runnable threads; the others are recorded so that
+    // they are not followed twice within one step.
+    void add(int pc, long long start) {
+        sparse[pc] = size;
+        densePc[size] = pc;
+        denseStart[size] = start;
+        size++;
+    }
+
+    void clear() {
+        size = 0;
+    }
+
+    int count() const {
+        return size;
+    }
+
+    int pc(int i) const {
+        return densePc[i];
+    }
+
+    long long start(int i) const {
+        return denseStart[i];
+    }
+};
+
+
+/* The memory the Pike VM works in.  It can be reused from one search to the
+ * next, so that searching does not allocate once it has grown big enough.
+ */
+struct PikeScratch {
+    ThreadList clist, nlist;
+    vector<int> stack;
+};
+
+
+NFAProgram compileNFA(const Program &program, bool reversed = false,
+                      pmr::memory_resource *resource =
+                          pmr::get_default_resource());
+NFAProgram compileNFA(const vector<RegexOperator *> &regex);
+
+void addThread(const NFAProgram &prog, ThreadList &list, vector<int> &stack,
+               int pc, long long start);
+
+Range pikeFind(const NFAProgram &prog, const string &s);
+Range pikeFind(const NFAProgram &prog, const string &s, PikeScratch &scratch,
+               int from = 0);
+Range pikeFind(const NFAProgram &prog, const char *data, int len,
+               PikeScratch &scratch, int from = 0);
+
+// Like pikeFind(), with 64-bit offsets, for inputs of any length.  If
+// "first" is not NULL, it holds every byte a match can start with, and the
+// bytes outside it are skipped while no thread is alive.
+LongRange pikeFindLong(const NFAProgram &prog, const char *data,
+                       long long len, PikeScratch &scratch,
+                       long long from = 0, const CharClass *first = NULL);
+
+// Returns true if the whole of data[0, len) matches.
+bool pikeMatch(const NFAProgram &prog, const char *data, long long len,
+               PikeScratch &scratch);
+
+#endif // NFA_HH
@@ -0,0 +1,122 @@
+#include "prefilter.h"
+
+#include <cstring>
+
+
+Prefilter::Prefilter(pmr::memory_resource *resource) : literal(resource) {
+    minOffset = 0;
+    maxOffset = 0;
+}
+
+
+/* Returns the index of the first occurrence of the literal that starts at or
+ * after "from", or -1 if there is none.  memchr() and memmem() are
+ * vectorized by the C library, so this skips over non-matching text far
+ * faster than trying the regex at every index.
+ */
+int Prefilter::next(const char *data, int len, int from) const {
+    int n = literal.length();
+    if (from < 0)
+        from = 0;
+    if (from + n > len)
+        return -1;
+
+    const char *found;
+    if (n == 1) {
+        found = (const char *) memchr(data + from, literal[0], len - from);
+    }
+    else {
+#ifdef __GLIBC__
+        found = (const char *) memmem(data + from, len - from,
+                                      literal.data(), n);
+#else
+        found = NULL;
+        const char *p = data + from;
+        const char *last = data + len - n;
+        while (p <= last) {
+            p = (const char *) memchr(p, literal[0], last - p + 1);
+            if (p == NULL)
+                break;
+            if (memcmp(p, literal.data(), n) == 0) {
+                found = p;
+                break;
+            }
+            p++;
+        }
+#endif
+    }
+
+    return found == NULL ? -1 : (int) (found - data);
+}
+
+
+/* Adds "n" to an offset, where -1 stands for "no limit". */
+static int addOffset(int offset, int n) {
+    if (offset == -1 || n == -1)
+        return -1;
+    return offset + n;
+}
+
+
+/* Keeps the better of two candidate literals: the longer one, or if they
+ * are the same length, the one at a fixed offset from the match start.
+ */
+static void consider(Prefilter &best, const Prefilter &candidate) {
+    size_t bestLen = best.literal.length();
+    size_t len = candidate.literal.length();
+    bool bestFixed = best.minOffset == best.maxOffset;
+    bool fixed = candidate.minOffset == candidate.maxOffset;
+
+    if (len > bestLen || (len == bestLen && len > 0 && fixed && !bestFixed))
+        best = candidate;
+}
+
+
+/* Finds the longest literal that every match of the program must contain.
+ * An OP_CHAR instruction with a minimum repeat of n always produces n copies
+ * of its character, and these join up with the copies produced by the
+ * instructions on either side.  A run ends at an instruction that can repeat
+ * a variable number of times, but the last n copies it produces start the
+ * next run.
+ */
+Prefilter buildPrefilter(const Program &prog, pmr::memory_resource *resource) {
+    Prefilter best(resource), current(resource);
+
+    // The offset range of the current instruction from the match start.
+    int prefixMin = 0, prefixMax = 0;
+
+    for (int i = 0; i < prog.size(); i++) {
+        const Inst &inst = prog[i];
+
+        if (inst.opcode != OP_CHAR || inst.minRepeat == 0) {
+            consider(best, current);
+            current = Prefilter(resource);
+        }
+        else {
+            pmr::string copies(inst.minRepeat, (char) inst.arg, resource);
+            bool fixed = inst.maxRepeat == inst.minRepeat;
+
+            if (current.empty()) {
+                current.minOffset = prefixMin;
+                current.maxOffset = prefixMax;
+            }
+            current.literal += copies;
+
+            if (!fixed) {
+                consider(best, current);
+
+                current = Prefilter(resource);
+                current.literal = copies;
+                current.minOffset = prefixMin;
+                current.maxOffset = addOffset(prefixMax, inst.maxRepeat == -1 ?
+                    -1 : inst.maxRepeat - inst.minRepeat);
+            }
+        }
+
+        prefixMin += inst.minRepeat;
+        prefixMax = addOffset(prefixMax, inst.maxRepeat);
+    }
+
+    consider(best, current);
+    return best;
+}
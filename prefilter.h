@@ -0,0 +1,41 @@
+#ifndef PREFILTER_HH
+#define PREFILTER_HH
+
+#include "./program.h"
+
+
+/* A literal string that every match of a regex must contain, found by
+ * looking for runs of OP_CHAR instructions that must match at least once.
+ * For example, "ERROR: \d+" must contain "ERROR: ", and "\d+ms timeout"
+ * must contain "ms timeout".
+ *
+ * The literal starts between minOffset and maxOffset characters after the
+ * start of the match (maxOffset is -1 if there is no limit), so a search only
+ * needs to try the start indexes near an occurrence of the literal, and can
+ * give up as soon as the literal does not occur in the rest of the string.
+ */
+class Prefilter {
+public:
+    // The required literal; empty if the regex has none.
+    pmr::string literal;
+
+    int minOffset;
+    int maxOffset;
+
+    explicit Prefilter(pmr::memory_resource *resource =
+                           pmr::get_default_resource());
+
+    bool empty() const {
+        return literal.empty();
+    }
+
+    // Returns the index of the first occurrence of the literal that starts
+    // at or after "from", or -1 if there is none.
+    int next(const char *data, int len, int from) const;
+};
+
+
+Prefilter buildPrefilter(const Program &prog, pmr::memory_resource *resource =
+                             pmr::get_default_resource());
+
+#endif // PREFILTER_HH
@@ -0,0 +1,134 @@
+#include "program.h"
+
+#include <cstring>
+
+
+Program::Program(pmr::memory_resource *resource) : block(resource) {
+    numInsts = 0;
+    numClasses = 0;
+}
+
+
+/* Returns the set of characters the instruction matches. */
+CharClass Program::classOf(const Inst &inst) const {
+    CharClass cls;
+    if (inst.opcode == OP_CHAR)
+        cls.add(inst.arg);
+    else if (inst.opcode == OP_CLASS)
+        cls = getClass(inst.arg);
+    else
+        cls.addAll();
+    return cls;
+}
+
+
+/* A program is a literal if every instruction matches one character a
+ * fixed number of times.
+ */
+bool Program::isLiteral(string &literal) const {
+    literal.clear();
+    for (int i = 0; i < numInsts; i++) {
+        const Inst &inst = (*this)[i];
+        if (inst.opcode != OP_CHAR || inst.minRepeat != inst.maxRepeat)
+            return false;
+        literal.append(inst.minRepeat, (char) inst.arg);
+    }
+    return !literal.empty();
+}
+
+
+/* Returns true if operator i of the regex can be possessive: none of its
+ * characters is in the class of an operator that can match first after it,
+ * which is any operator up to and including the first one that has to
+ * match at least once.  If every later operator can match nothing, what
+ * follows a given-back character still has to either start with it or be
+ * empty, and an empty match there would have matched after the whole run
+ * already (or, for match(), cannot reach the end of the string).
+ */
+static bool canBePossessive(RegexOperator *const *regex, size_t n,
+                            size_t i) {
+    const RegexOperator *op = regex[i];
+    if (op->getMinRepeat() == op->getMaxRepeat())
+        return false;
+
+    size_t last = i + 1;
+    while (last < n && regex[last]->getMinRepeat() == 0)
+        last++;
+    if (last == n)
+        last--;
+
+    for (int c = 0; c < 256; c++) {
+        if (!op->getClass().contains(c))
+            continue;
+        for (size_t j = i + 1; j <= last; j++) {
+            if (regex[j]->getClass().contains(c))
+                return false;
+        }
+    }
+    return true;
+}
+
+
+/* Lowers the parsed regex into a flat program.  The operators are only read,
+ * so they can be freed as soon as this returns.  All the memory used,
+ * including for the work lists, comes from "resource".
+ */
+Program compileProgram(const vector<RegexOperator *> &regex,
+                       pmr::memory_resource *resource) {
+    return compileProgram(regex.data(), regex.size(), resource);
+}
+
+
+Program compileProgram(RegexOperator *const *regex, size_t n,
+                       pmr::memory_resource *resource) {
+    pmr::vector<CharClass> classes(resource);
+    pmr::vector<Inst> insts(resource);
+    insts.reserve(n);
+
+    for (size_t i = 0; i < n; i++) {
+        const RegexOperator *op = regex[i];
+        const CharClass &cls = op->getClass();
+
+        Inst inst;
+        inst.flags = canBePossessive(regex, n, i) ? INST_POSSESSIVE : 0;
+        inst.minRepeat = op->getMinRepeat();
+        inst.maxRepeat = op->getMaxRepeat();
+
+        int count = cls.count();
+        if (count == 256) {
+            inst.opcode = OP_ANY;
+            inst.arg = 0;
+        }
+        else if (count == 1) {
+            int c = 0;
+            while (!cls.contains(c))
+                c++;
+            inst.opcode = OP_CHAR;
+            inst.arg = c;
+        }
+        else {
+            size_t k = 0;
+            while (k < classes.size() &&
+                   memcmp(&classes[k], &cls, sizeof(CharClass)) != 0)
+                k++;
+            if (k == classes.size())
+                classes.push_back(cls);
+            inst.opcode = OP_CLASS;
+            inst.arg = k;
+        }
+
+        insts.push_back(inst);
+    }
+
+    Program prog(resource);
+    prog.numInsts = insts.size();
+    prog.numClasses = classes.size();
+
+    size_t classBytes = classes.size() * sizeof(CharClass);
+    size_t instBytes = insts.size() * sizeof(Inst);
+    prog.block.resize((classBytes + instBytes + 7) / 8);
+    memcpy(prog.block.data(), classes.data(), classBytes);
+    memcpy((char *) prog.block.data() + classBytes, insts.data(), instBytes);
+
+    return prog;
+}
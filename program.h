@@ -0,0 +1,119 @@
+#ifndef PROGRAM_HH
+#define PROGRAM_HH
+
+#include "./regex.h"
+
+
+/* The kinds of instruction in a compiled program.  Each one matches a single
+ * character, between minRepeat and maxRepeat times.
+ *
+ *   OP_CHAR   matches the character "arg".
+ *   OP_CLASS  matches any character in class number "arg".
+ *   OP_ANY    matches any character at all.
+ */
+enum Opcode {
+    OP_CHAR,
+    OP_CLASS,
+    OP_ANY
+};
+
+/* Flags of an instruction, set by compileProgram().
+ *
+ *   INST_POSSESSIVE  no character the instruction matches can start what
+ *                    the instructions after it match, so giving back part
+ *                    of its run never lets them match.  The backtracking
+ *                    engines un-apply it instead.
+ */
+enum InstFlag {
+    INST_POSSESSIVE = 1
+};
+
+struct Inst {
+    uint8_t opcode;
+    uint8_t flags;
+    uint16_t arg;
+    int32_t minRepeat;
+    int32_t maxRepeat;
+};
+
+
+/* What one instruction of the backtracking engine has matched: a run of
+ * "count" characters from index "start".  Every instruction matches one
+ * character at a time, so giving one back is a decrement.
+ */
+struct RunState {
+    int start;
+    int count;
+};
+
+
+/* A regex lowered from its RegexOperator objects into a flat program: one
+ * contiguous block holding the character classes (32 bytes each) followed
+ * by the instructions (12 bytes each).  A regex of a few operators fits in
+ * one or two cache lines, and the matchers run it with a switch on the
+ * opcode instead of virtual calls through scattered heap objects.
+ *
+ * Identical classes are stored once, and classes that hold a single
+ * character or every character become OP_CHAR and OP_ANY instructions.
+ *
+ * The block is allocated from a memory resource, so that a CompiledRegex can
+ * keep everything it owns in one arena.
+ */
+class Program {
+    pmr::vector<uint64_t> block;
+    int numInsts;
+    int numClasses;
+
+public:
+    explicit Program(pmr::memory_resource *resource =
+                         pmr::get_default_resource());
+
+    int size() const {
+        return numInsts;
+    }
+
+    int getNumClasses() const {
+        return numClasses;
+    }
+
+    const CharClass &getClass(int i) const {
+        return ((const CharClass *) block.data())[i];
+    }
+
+    const Inst &operator[](int i) const {
+        return ((const Inst *) (block.data() + 4 * numClasses))[i];
+    }
+
+    // Returns true if the instruction matches the character.
+    bool matches(const Inst &inst, unsigned char c) const {
+        switch (inst.opcode) {
+        case OP_CHAR:
+            return c == inst.arg;
+        case OP_CLASS:
+            return getClass(inst.arg).contains(c);
+        default:
+            return true;
+        }
+    }
+
+    // Returns the set of characters the instruction matches.
+    CharClass classOf(const Inst &inst) const;
+
+    // Returns true if the program only matches one non-empty string, which
+    // is stored in "literal".
+    bool isLiteral(string &literal) const;
+
+    friend Program compileProgram(RegexOperator *const *regex, size_t n,
+                                  pmr::memory_resource *resource);
+};
+
+
+Program compileProgram(const vector<RegexOperator *> &regex,
+                       pmr::memory_resource *resource =
+                           pmr::get_default_resource());
+
+// Compiles the n operators at "regex", which may be held in any vector.
+Program compileProgram(RegexOperator *const *regex, size_t n,
+                       pmr::memory_resource *resource);
+
+#endif // PROGRAM_HH
@@ -1,5 +1,8 @@
 #include "regex.h"
+#include <algorithm>
+#include <cstddef>
 #include <iostream>
+#include <new>
 #include <vector>
 
  
@@ -36,46 +39,72 @@ void RegexOperator::setMaxRepeat(int n) {
 }
 
 
-/* Clears the list of matches stored in the regex operator.  Typically done
- * in preparation to try to match the regex to a new string.
+/* Returns the set of characters the operator matches. */
+const CharClass &RegexOperator::getClass() const {
+    return cls;
+}
+
+
+/* Matches the character at r.start against the operator's class.  On a
+ * match, r is set to the one-character range that was consumed.
  */
-void RegexOperator::clearMatches() {
-    matches.clear();
+bool RegexOperator::match(const string &s, Range &r) const {
+    if(r.start >= (int) s.length() || !cls.contains(s[r.start])) return false;
+    r.end = r.start + 1;
+    return true;
 }
 
 
-/* Records a new match of the operator in the list of matches. */
-void RegexOperator::pushMatch(const Range &r) {
-    matches.push_back(r);
+CharClass::CharClass() {
+    bits[0] = bits[1] = bits[2] = bits[3] = 0;
 }
 
+void CharClass::add(unsigned char c) {
+    bits[c >> 6] |= (uint64_t) 1 << (c & 63);
+}
 
-/* Reports how many times the regex operator has successfully matched in the
- * string.
- */
-int RegexOperator::numMatches() const {
-    return (int) matches.size();
+void CharClass::addRange(unsigned char lo, unsigned char hi) {
+    for(int c = lo; c <= hi; c++)
+        add(c);
 }
 
+void CharClass::addAll() {
+    bits[0] = bits[1] = bits[2] = bits[3] = ~(uint64_t) 0;
+}
 
-/* Removes the last match the operator successfully matched against.  Used for
- * backtracking by the regex engine.
- */
-Range RegexOperator::popMatch() {
-    Range r = matches.back();
-    matches.pop_back();
-    return r;
+void CharClass::invert() {
+    for(int i=0; i<4; i++)
+        bits[i] = ~bits[i];
 }
 
-MatchChar::MatchChar(char ch) {
-    c = ch;
+int CharClass::count() const {
+    int n = 0;
+    for(int i=0; i<4; i++)
+        n += __builtin_popcountll(bits[i]);
+    return n;
 }
 
-bool MatchChar::match(const string &s, Range &r) const
+/* Adds the contents of a set written between [ and ] to the class.  "x-y"
+ * adds every character from x to y.
+ */
+static void addSubset(CharClass &cls, string_view str)
 {
-    if(r.start >= (int) s.length() || s[r.start]!=c) return false;
-    r.end = r.start + 1;
-    return true;
+    size_t len = str.length();
+    for(size_t i=0; i<len; i++)
+    {
+        if(i+2 < len and str[i+1]=='-')
+        {
+            cls.addRange(str[i], str[i+2]);
+            i = i+2;
+        }
+        else
+            cls.add(str[i]);
+    }
+}
+
+MatchChar::MatchChar(char ch) {
+    c = ch;
+    cls.add(c);
 }
 
 MatchAny :: MatchAny(bool Dot, bool Digit, bool AlNumeric, bool Space) {
@@ -83,45 +112,17 @@ MatchAny :: MatchAny(bool Dot, bool Digit, bool AlNumeric, bool Space) {
     digit = Digit;
     alphaNumeric = AlNumeric;
     space = Space;
-}
 
-bool MatchAny :: match(const string &s, Range &r) const
-{
-    if(r.start >= (int) s.length()) return false;
-
-    bool found=1;
-    if(dot) found = 1;
-    else if(digit)
-    {
-        if(s[r.start] >= '0' && s[r.start]<='9')
-            found = 1;
-        else 
-            found = 0;
-    }
+    if(dot) cls.addAll();
+    else if(digit) cls.addRange('0', '9');
     else if(alphaNumeric)
     {
-        if( (s[r.start] >= 'a' && s[r.start]<='z') || 
-            (s[r.start] >= 'A' && s[r.start]<='Z') ||
-            (s[r.start] >= '0' && s[r.start]<='9') ||
-            s[r.start] == '_' ) 
-            {
-                found = 1;
-            }
-        else    
-            found = 0;
-    }
-    else if(space)
-    {
-        if(s[r.start] == ' ')
-            found = 1;
-        else 
-            found = 0;
+        cls.addRange('a', 'z');
+        cls.addRange('A', 'Z');
+        cls.addRange('0', '9');
+        cls.add('_');
     }
-    
-    if(!found) return false;
-
-    r.end = r.start+1;
-    return true;
+    else if(space) cls.add(' ');
 }
 
 char MatchAny :: identify()
@@ -132,80 +133,77 @@ char MatchAny :: identify()
     return 'S';
 }
 
-MatchFromSubset :: MatchFromSubset(string s)
+MatchFromSubset :: MatchFromSubset(string_view s)
 {
-    str = s;
-    len = str.length();
+    addSubset(cls, s);
 }
 
-bool MatchFromSubset :: match(const string &s, Range &r) const
+ExcludeFromSubset :: ExcludeFromSubset(string_view s)
 {
-    if(r.start >= (int)s.length()) return false;
-    bool found=0;
-    
-    for(int i=0; i<len; i++)
-    {
-        if(i+2 < len and str[i+1]=='-')
-        {
-            int startChar = str[i], endChar = str[i+2];
-            if(s[r.start]>=startChar and s[r.start]<=endChar)
-            {
-                found = 1;
-                break;
-            }
-            i = i+2;
-            continue;
-        }
-        else if(str[i] == s[r.start])
-        {
-            found = 1;
-            break;
-        }
-    }  
-    
-    if(found) r.end = r.start + 1;
-    return found;
+    addSubset(cls, s);
+    cls.invert();
 }
 
-ExcludeFromSubset :: ExcludeFromSubset(string s)
+/* Prints the characters of a set the way they are written between [ and ],
+ * with "x-y" for each run of three or more.
+ */
+static void printSubset(const CharClass &cls)
 {
-    str = s;
-    len = str.length();
+    for(int c=0; c<256; c++)
+    {
+        if(!cls.contains(c))
+            continue;
+        int last = c;
+        while(last+1 < 256 and cls.contains(last+1))
+            last++;
+        if(last - c >= 2)
+            std::cout<<(char) c<<'-'<<(char) last;
+        else
+            for(int k=c; k<=last; k++)
+                std::cout<<(char) k;
+        c = last;
+    }
 }
 
 char MatchFromSubset :: identify(){
-    std::cout<<str;
+    printSubset(cls);
     return ' ';
 }
 
 char ExcludeFromSubset :: identify(){
-    std::cout<<"^ "<<str;
+    CharClass excluded = cls;
+    excluded.invert();
+    std::cout<<"^ ";
+    printSubset(excluded);
     return ' ';
 }
 
-bool ExcludeFromSubset :: match(const string &s, Range &r) const
-{
-    if(r.start >= (int) s.length()) return false;
-    bool found=0; // stores if s[r.start] is present in str or not
-
-    for(int i=0; i<len; i++)
-    {
-        if(s[r.start] == str[i])
-        {
-            found = 1;
-            break;
-        }
-    }
+// Every kind of operator fits in a slot of this size, so that operators can
+// be given back to a memory resource without knowing their type.
+const size_t OPERATOR_SLOT_BYTES = max(max(sizeof(MatchChar), sizeof(MatchAny)),
+    max(sizeof(MatchFromSubset), sizeof(ExcludeFromSubset)));
+const size_t OPERATOR_SLOT_ALIGN = alignof(max_align_t);
 
-    found = !found; // if not present then return true;
 
-    if(found) r.end = r.start +1;
-    return found;
+/* Creates an operator, from the heap if "resource" is NULL. */
+template <class T, class... Args>
+static RegexOperator *newOperator(pmr::memory_resource *resource,
+                                  Args... args)
+{
+    if(resource == NULL)
+        return new T(args...);
+    void *slot = resource->allocate(OPERATOR_SLOT_BYTES, OPERATOR_SLOT_ALIGN);
+    return new(slot) T(args...);
 }
 
-vector<RegexOperator *> parseRegex(const string &expr)
+/* Parses the regex into "parsed", which may be a vector from either the
+ * heap or a memory resource.
+ */
+template <class Vector>
+static void parseInto(const string &expr, pmr::memory_resource *resource,
+                      Vector &parsed)
 {
-    vector<RegexOperator *> parsed;
+    parsed.reserve(expr.length());
 
     size_t len = expr.length();
     for(size_t i=0; i<len; i++)
@@ -223,15 +221,15 @@ vector<RegexOperator *> parseRegex(const string &expr)
             {
                 startIndex = i+2;
                 endIndex--;
-                string subset = expr.substr( startIndex, endIndex - startIndex + 1);
-                op = new ExcludeFromSubset(subset);
+                string_view subset = string_view(expr).substr(startIndex, endIndex - startIndex + 1);
+                op = newOperator<ExcludeFromSubset>(resource, subset);
             }
             else
             {
                 startIndex = i+1;
                 endIndex--;
-                string subset = expr.substr(startIndex, endIndex - startIndex + 1);
-                op = new MatchFromSubset(subset);
+                string_view subset = string_view(expr).substr(startIndex, endIndex - startIndex + 1);
+                op = newOperator<MatchFromSubset>(resource, subset);
             }
             endIndex += 2;
             
@@ -244,19 +242,19 @@ vector<RegexOperator *> parseRegex(const string &expr)
                 if(expr[i+1]=='.' || expr[i+1]=='\\')
                 {
                     endIndex = i+2;
-                    op = new MatchChar(expr[i+1]);
+                    op = newOperator<MatchChar>(resource, expr[i+1]);
                     parsed.push_back(op);
                 }
                 else if(expr[i+1]=='d') // "\d -> Matches nums between 0-9"
                 {
                     endIndex = i+2; 
-                    op = new MatchAny(0, 1, 0, 0);
+                    op = newOperator<MatchAny>(resource, 0, 1, 0, 0);
                     parsed.push_back(op);
                 }
                 else if(expr[i+1]=='w') // "\w -> matches alphaNumeric and _"
                 {
                     endIndex = i+2; 
-                    op = new MatchAny(0, 0, 1, 0);
+                    op = newOperator<MatchAny>(resource, 0, 0, 1, 0);
                     parsed.push_back(op);
                 }
                 else if(expr[i+1]=='s') // "\s -> matches a white space"
@@ -264,19 +262,19 @@ vector<RegexOperator *> parseRegex(const string &expr)
                     endIndex = i+2; 
                 endIndex = i+2;
                     endIndex = i+2; 
-                    op = new MatchAny(0, 0, 0, 1);
+                    op = newOperator<MatchAny>(resource, 0, 0, 0, 1);
                     parsed.push_back(op);
                 }
             }
         }
         else if(expr[i] == '.') // "." -> matches any character.
         {
-            op = new MatchAny(1, 0, 0, 0);
+            op = newOperator<MatchAny>(resource, 1, 0, 0, 0);
             parsed.push_back(op);
         }
         else
         {
-            op = new MatchChar(expr[i]);
+            op = newOperator<MatchChar>(resource, expr[i]);
             parsed.push_back(op);
         }
 
@@ -329,11 +327,24 @@ vector<RegexOperator *> parseRegex(const string &expr)
         // so if not found then i<endIndex.
         if(i < endIndex) i = endIndex - 1;
     }
+}
 
+vector<RegexOperator *> parseRegex(const string &expr)
+{
+    vector<RegexOperator *> parsed;
+    parseInto(expr, NULL, parsed);
     return parsed;
 }
 
-void clearRegex(vector<RegexOperator *> regex)
+pmr::vector<RegexOperator *> parseRegex(const string &expr,
+                                        pmr::memory_resource *resource)
+{
+    pmr::vector<RegexOperator *> parsed(resource);
+    parseInto(expr, resource, parsed);
+    return parsed;
+}
+
+void clearRegex(vector<RegexOperator *> &regex)
 {
     int n = regex.size();
     for(int i=0; i<n ;i++)
@@ -343,6 +354,19 @@ void clearRegex(vector<RegexOperator *> regex)
     regex.clear();
 }
 
+void clearRegex(pmr::vector<RegexOperator *> &regex,
+                pmr::memory_resource *resource)
+{
+    int n = regex.size();
+    for(int i=0; i<n ;i++)
+    {
+        regex[i]->~RegexOperator();
+        resource->deallocate(regex[i], OPERATOR_SLOT_BYTES,
+                             OPERATOR_SLOT_ALIGN);
+    }
+    regex.clear();
+}
+
 // int main()
 // {
 //     string regex = "\\d{2,3}";
@@ -1,5 +1,11 @@
+#ifndef REGEX_HH
+#define REGEX_HH
+
 #include <cassert>
+#include <cstdint>
+#include <memory_resource>
 #include <string>
+#include <string_view>
 #include <vector>
 
 using namespace std;
@@ -44,21 +50,64 @@ public:
 };
 
 
+/* A range with 64-bit offsets, for inputs longer than an int can index, such
+ * as a memory-mapped file or a stream.  (-1, -1) means there is no match.
+ */
+struct LongRange {
+    long long start;
+    long long end;
+
+    LongRange(long long start = -1, long long end = -1) :
+        start(start), end(end) { }
+};
+
+
+/* A set of characters, stored as a 256-bit bitmap with one bit per possible
+ * byte value, so that testing a character is a single bit test however the
+ * set was written.
+ */
+class CharClass {
+    uint64_t bits[4];
+
+public:
+    // Initialize an empty set.
+    CharClass();
+
+    void add(unsigned char c);
+    void addRange(unsigned char lo, unsigned char hi);
+    void addAll();
+    void invert();
+
+    bool contains(unsigned char c) const {
+        return (bits[c >> 6] >> (c & 63)) & 1;
+    }
+
+    // Returns the number of characters in the set.
+    int count() const;
+};
+
+
 /* A class for representing operations that can be performed in a regular
  * expression.
  * The minimum and maximum number of times the operator is *required* to
  * match.  The minimum value must be at least 0.  The maximum value must be
  * at least -1; -1 indicates "unlimited matches", and all other values
  * specify an actual maximum number of matches.
+ *
+ * Operators hold no matching state (the engines keep that in a
+ * MatchScratch), so a parsed regex can be used by several threads at once.
 */
 class RegexOperator {
     int minRepeat, maxRepeat;
-    
-    // A vector of ranges where the regex operator has matched the test string.
-    vector<Range> matches;
+
+protected:
+    // The characters the operator matches, filled in by each subclass when
+    // it is constructed.
+    CharClass cls;
     
 public:
     RegexOperator();
+    virtual ~RegexOperator() { }
 
     // Operations to support optional and repeat operations.
     int getMinRepeat() const;
@@ -66,13 +115,10 @@ public:
     void setMinRepeat(int n);
     void setMaxRepeat(int n);
 
-    // Operations to support backtracking
-    void clearMatches();
-    void pushMatch(const Range &r);
-    int numMatches() const;
-    Range popMatch();
+    // Every operator matches exactly one character from its class.
+    const CharClass &getClass() const;
+    bool match(const string& s, Range& r) const;
 
-    virtual bool match(const string& s, Range& r) const = 0;
     virtual char identify() = 0;
 };
 
@@ -86,7 +132,6 @@ private:
 public:
     MatchChar(char ch);
 
-    bool match(const string& s, Range& r) const;
     char identify() {return c;}
 };
 
@@ -100,43 +145,45 @@ class MatchAny : public RegexOperator {
 public:
     MatchAny(bool Dot, bool Digit, bool AlNumeric, bool Space);
 
-    bool match(const string& s, Range& r) const;
     char identify();
 };
 
 /* Implements the set, it stores the values in that set [...]
- * and implements the match function for chars, 
+ * (including ranges such as a-z) in its class,
  * minRepeat = 0 and maxRepeat = -1 for * operator
  * minRepeat = 1 and maxRepeat = -1 for + operator
  * minRepeat = 0 and maxRepeat = 1 for ? operator
 */
 class MatchFromSubset : public RegexOperator {
-private: 
-    string str;
-    size_t len;
 public:
-    MatchFromSubset(string s);
+    MatchFromSubset(string_view s);
 
-    bool match(const string& s, Range& r) const;
     char identify();
 };
 
 
-/* Implements the excluding set [^....]
+/* Implements the excluding set [^....], which understands the same ranges
+ * as [...]
  * minRepeat = 0 and maxRepeat = -1 for * operator
  * minRepeat = 1 and maxRepeat = -1 for + operator
  * minRepeat = 0 and maxRepeat = 1 for ? operator
 */
 class ExcludeFromSubset : public RegexOperator {
-private:  
-    string str;
-    size_t len;
 public:
-    ExcludeFromSubset(string s);
+    ExcludeFromSubset(string_view s);
 
-    bool match(const string& s, Range& r) const;
     char identify();
 };
 
 vector<RegexOperator *> parseRegex(const string &expr);
-void clearRegex(vector<RegexOperator *> regex);
+void clearRegex(vector<RegexOperator *> &regex);
+
+// These allocate the operators, and the vector that holds them, from a
+// memory resource, such as an arena, and give them back to it.  With a
+// monotonic arena, freeing the arena frees the whole regex at once.
+pmr::vector<RegexOperator *> parseRegex(const string &expr,
+                                        pmr::memory_resource *resource);
+void clearRegex(pmr::vector<RegexOperator *> &regex,
+                pmr::memory_resource *resource);
+
+#endif // REGEX_HH
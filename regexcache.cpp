@@ -0,0 +1,105 @@
+#include "regexcache.h"
+
+#include <functional>
+
+
+/* The capacity is split evenly between the shards, so that eviction only
+ * ever needs to look at one shard.
+ */
+RegexCache::RegexCache(size_t capacity, int numShards) {
+    if (numShards < 1)
+        numShards = 1;
+    for (int i = 0; i < numShards; i++)
+        shards.push_back(unique_ptr<Shard>(new Shard()));
+
+    shardCapacity = (capacity + numShards - 1) / numShards;
+    if (shardCapacity == 0)
+        shardCapacity = 1;
+}
+
+
+RegexCache::Shard &RegexCache::shardOf(const string &expr) const {
+    size_t h = hash<string>()(expr);
+    return *shards[h % shards.size()];
+}
+
+
+shared_ptr<const CompiledRegex> RegexCache::get(const string &expr) {
+    Shard &shard = shardOf(expr);
+
+    {
+        lock_guard<mutex> guard(shard.lock);
+        auto iter = shard.index.find(expr);
+        if (iter != shard.index.end()) {
+            shard.stats.hits++;
+            shard.lru.splice(shard.lru.begin(), shard.lru, iter->second);
+            return iter->second->second;
+        }
+        shard.stats.misses++;
+    }
+
+    Entry compiled(new CompiledRegex(expr));
+
+    // Evicted regexes are freed after the lock is released.
+    vector<Entry> evicted;
+    lock_guard<mutex> guard(shard.lock);
+
+    // Another thread may have compiled the same pattern in the meantime;
+    // keep the one that is already shared.
+    auto iter = shard.index.find(expr);
+    if (iter != shard.index.end()) {
+        shard.lru.splice(shard.lru.begin(), shard.lru, iter->second);
+        return iter->second->second;
+    }
+
+    shard.lru.push_front(make_pair(expr, compiled));
+    shard.index[expr] = shard.lru.begin();
+
+    while (shard.lru.size() > shardCapacity) {
+        evicted.push_back(shard.lru.back().second);
+        shard.index.erase(shard.lru.back().first);
+        shard.lru.pop_back();
+        shard.stats.evictions++;
+    }
+
+    return compiled;
+}
+
+
+size_t RegexCache::size() const {
+    size_t total = 0;
+    for (size_t i = 0; i < shards.size(); i++) {
+        lock_guard<mutex> guard(shards[i]->lock);
+        total += shards[i]->lru.size();
+    }
+    return total;
+}
+
+
+void RegexCache::clear() {
+    for (size_t i = 0; i < shards.size(); i++) {
+        lock_guard<mutex> guard(shards[i]->lock);
+        shards[i]->index.clear();
+        shards[i]->lru.clear();
+    }
+}
+
+
+RegexCacheStats RegexCache::getStats() const {
+    RegexCacheStats total;
+    for (size_t i = 0; i < shards.size(); i++) {
+        lock_guard<mutex> guard(shards[i]->lock);
+        total.hits += shards[i]->stats.hits;
+        total.misses += shards[i]->stats.misses;
+        total.evictions += shards[i]->stats.evictions;
+    }
+    return total;
+}
+
+
+void RegexCache::resetStats() {
+    for (size_t i = 0; i < shards.size(); i++) {
+        lock_guard<mutex> guard(shards[i]->lock);
+        shards[i]->stats = RegexCacheStats();
+    }
+}
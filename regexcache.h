@@ -0,0 +1,74 @@
+#ifndef REGEXCACHE_HH
+#define REGEXCACHE_HH
+
+#include "./compiled.h"
+
+#include <list>
+#include <mutex>
+#include <unordered_map>
+
+
+/* Counters that describe how well a RegexCache is working. */
+struct RegexCacheStats {
+    // Lookups that found the regex already compiled.
+    long long hits;
+
+    // Lookups that had to parse and compile the regex.
+    long long misses;
+
+    // Regexes dropped to stay within the size limit.
+    long long evictions;
+
+    RegexCacheStats() : hits(0), misses(0), evictions(0) { }
+};
+
+
+/* Compiled regexes kept by pattern text, so that a pattern that is seen
+ * again costs one hash lookup instead of a parse and a compile.  The least
+ * recently used regexes are dropped once the cache holds "capacity" of them.
+ *
+ * The cache is split into shards, each with its own lock and LRU list, and
+ * a pattern always goes to the same shard, so threads looking up different
+ * patterns rarely wait for each other.  Regexes are handed out as shared
+ * pointers to const objects: they can be used from any thread, and one that
+ * is evicted stays alive until its last user lets go of it.  Patterns are
+ * compiled without holding a lock.
+ */
+class RegexCache {
+    typedef shared_ptr<const CompiledRegex> Entry;
+    typedef list<pair<string, Entry> > LRUList;
+
+    struct Shard {
+        mutex lock;
+
+        // Most recently used first.
+        LRUList lru;
+        unordered_map<string, LRUList::iterator> index;
+        RegexCacheStats stats;
+    };
+
+    vector<unique_ptr<Shard> > shards;
+    size_t shardCapacity;
+
+    Shard &shardOf(const string &expr) const;
+
+public:
+    explicit RegexCache(size_t capacity = 1024, int numShards = 16);
+
+    RegexCache(const RegexCache &) = delete;
+    RegexCache &operator=(const RegexCache &) = delete;
+
+    // Returns the compiled regex for the pattern, compiling it if needed.
+    shared_ptr<const CompiledRegex> get(const string &expr);
+
+    // Returns the number of regexes in the cache.
+    size_t size() const;
+
+    // Drops every regex.  The statistics are kept.
+    void clear();
+
+    RegexCacheStats getStats() const;
+    void resetStats();
+};
+
+#endif // REGEXCACHE_HH
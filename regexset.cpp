@@ -0,0 +1,157 @@
+#include "regexset.h"
+
+
+RegexSet::RegexSet(const vector<vector<RegexOperator *> > &patterns,
+                   size_t maxCacheBytes) {
+    for (size_t i = 0; i < patterns.size(); i++)
+        regexes.push_back(unique_ptr<CompiledRegex>(
+            new CompiledRegex(patterns[i])));
+    build(maxCacheBytes);
+}
+
+
+RegexSet::RegexSet(const vector<string> &patterns, size_t maxCacheBytes) {
+    for (size_t i = 0; i < patterns.size(); i++)
+        regexes.push_back(unique_ptr<CompiledRegex>(
+            new CompiledRegex(patterns[i])));
+    build(maxCacheBytes);
+}
+
+
+/* Adds the literal patterns to the Aho-Corasick automaton, and merges the
+ * NFAs of the others into one.  Their instructions are copied one after the
+ * other, with their targets and classes moved along, and every NFA_MATCH is
+ * tagged with its pattern's index.  A chain of splits leads into each
+ * pattern; the order of the branches does not matter, since the DFA keeps
+ * every thread.
+ */
+void RegexSet::build(size_t maxCacheBytes) {
+    isLiteral.assign(regexes.size(), 0);
+    numMerged = 0;
+
+    for (size_t i = 0; i < regexes.size(); i++) {
+        string literal;
+        if (regexes[i]->getProgram().isLiteral(literal)) {
+            literals.add(literal, i);
+            isLiteral[i] = 1;
+            continue;
+        }
+
+        const NFAProgram &nfa = regexes[i]->getForward();
+        int base = merged.insts.size();
+        int clsBase = merged.classes.size();
+
+        for (size_t pc = 0; pc < nfa.insts.size(); pc++) {
+            NFAInst inst = nfa.insts[pc];
+            if (inst.opcode == NFA_MATCH) {
+                inst.x = i;
+            }
+            else {
+                if (inst.cls != -1)
+                    inst.cls += clsBase;
+                if (inst.x != -1)
+                    inst.x += base;
+                if (inst.y != -1)
+                    inst.y += base;
+            }
+            merged.insts.push_back(inst);
+        }
+        merged.classes.insert(merged.classes.end(), nfa.classes.begin(),
+                              nfa.classes.end());
+
+        // Add this pattern to the chain of splits.
+        NFAInst link;
+        link.cls = -1;
+        if (numMerged++ == 0) {
+            link.opcode = NFA_JMP;
+            link.x = base + nfa.start;
+            link.y = -1;
+        }
+        else {
+            link.opcode = NFA_SPLIT;
+            link.x = merged.start;
+            link.y = base + nfa.start;
+        }
+        merged.insts.push_back(link);
+        merged.start = merged.insts.size() - 1;
+    }
+
+    literals.build();
+    if (numMerged > 0)
+        cache.reset(new DFACache(merged, maxCacheBytes, DFA_ALL));
+}
+
+
+/* Sets "matched" for the patterns that match the string.  Returns true if
+ * any does.
+ */
+bool RegexSet::scan(const string &s) {
+    matched.assign(regexes.size(), 0);
+    ranges.assign(regexes.size(), Range(-1, -1));
+
+    int numLiterals = 0;
+    literals.findFirst(s.data(), s.length(), matched, ranges, numLiterals,
+                       literals.size());
+
+    int numMatched = 0;
+    if (cache && !cache->runAll(s.data(), s.length(), matched, numMatched,
+                                numMerged, stats)) {
+        // The cache is thrashing; search for the remaining patterns one by
+        // one instead.
+        stats.fallbacks++;
+        for (size_t i = 0; i < regexes.size(); i++) {
+            if (!isLiteral[i] && !matched[i] &&
+                ::find(*regexes[i], s, scratch).start != -1) {
+                matched[i] = 1;
+                numMatched++;
+            }
+        }
+    }
+    return numLiterals + numMatched > 0;
+}
+
+
+int RegexSet::size() const {
+    return regexes.size();
+}
+
+
+const CompiledRegex &RegexSet::getRegex(int i) const {
+    return *regexes[i];
+}
+
+
+vector<int> RegexSet::matches(const string &s) {
+    vector<int> result;
+    if (scan(s)) {
+        for (size_t i = 0; i < regexes.size(); i++) {
+            if (matched[i])
+                result.push_back(i);
+        }
+    }
+    return result;
+}
+
+
+vector<SetMatch> RegexSet::find(const string &s) {
+    vector<SetMatch> result;
+    if (scan(s)) {
+        for (size_t i = 0; i < regexes.size(); i++) {
+            if (matched[i] && isLiteral[i])
+                result.push_back(SetMatch(i, ranges[i]));
+            else if (matched[i])
+                result.push_back(SetMatch(i, ::find(*regexes[i], s, scratch)));
+        }
+    }
+    return result;
+}
+
+
+const DFAStats &RegexSet::getStats() const {
+    return stats;
+}
+
+
+void RegexSet::resetStats() {
+    stats = DFAStats();
+}
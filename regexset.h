@@ -0,0 +1,80 @@
+#ifndef REGEXSET_HH
+#define REGEXSET_HH
+
+#include "./aho.h"
+#include "./engine.h"
+
+
+/* A pattern of a RegexSet that matched, and its leftmost match. */
+struct SetMatch {
+    int pattern;
+    Range range;
+
+    SetMatch(int pattern, const Range &range) :
+        pattern(pattern), range(range) { }
+};
+
+
+/* Many regexes searched for together.  Their NFAs are merged into one, with
+ * a split at the start leading into each of them and a separate NFA_MATCH
+ * instruction for each, and a lazy DFA built from the merged NFA finds
+ * which patterns match in one pass over the input.  Each byte usually costs
+ * a single table lookup however many patterns there are; only the number of
+ * DFA states grows with them.
+ *
+ * Patterns that are plain literals, such as hostnames or error codes, are
+ * left out of the NFA and found with an Aho-Corasick automaton instead,
+ * which also tells where they first occur.  Finding where the other
+ * patterns match takes one more search for each of them that matches.
+ *
+ * Like LazyDFA, a RegexSet owns its DFA cache and must only be used by one
+ * thread at a time.
+ */
+class RegexSet {
+    vector<unique_ptr<CompiledRegex> > regexes;
+
+    // For each pattern, whether it is searched for by "literals".
+    vector<char> isLiteral;
+    AhoCorasick literals;
+
+    // The other patterns, merged; "cache" is NULL if there are none.
+    NFAProgram merged;
+    int numMerged;
+    unique_ptr<DFACache> cache;
+
+    MatchScratch scratch;
+    DFAStats stats;
+
+    // For each pattern, whether it matched the current input, and where the
+    // literals first occur in it.
+    vector<char> matched;
+    vector<Range> ranges;
+
+    void build(size_t maxCacheBytes);
+    bool scan(const string &s);
+
+public:
+    explicit RegexSet(const vector<vector<RegexOperator *> > &patterns,
+                      size_t maxCacheBytes = DFA_DEFAULT_CACHE_BYTES);
+    explicit RegexSet(const vector<string> &patterns,
+                      size_t maxCacheBytes = DFA_DEFAULT_CACHE_BYTES);
+
+    RegexSet(const RegexSet &) = delete;
+    RegexSet &operator=(const RegexSet &) = delete;
+
+    int size() const;
+    const CompiledRegex &getRegex(int i) const;
+
+    // Returns the indexes of the patterns that match somewhere in the
+    // string, in increasing order.
+    vector<int> matches(const string &s);
+
+    // Returns the leftmost match of every pattern that matches, in order of
+    // pattern index.
+    vector<SetMatch> find(const string &s);
+
+    const DFAStats &getStats() const;
+    void resetStats();
+};
+
+#endif // REGEXSET_HH
@@ -0,0 +1,201 @@
+#include "simd.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define HAVE_X86_KERNELS 1
+#endif
+
+
+ClassScanner::ClassScanner(const CharClass &cls) : cls(cls) {
+    for (int lo = 0; lo < 16; lo++) {
+        lowTable[lo] = 0;
+        highTable[lo] = 0;
+        for (int hi = 0; hi < 8; hi++) {
+            if (cls.contains(hi << 4 | lo))
+                lowTable[lo] |= 1 << hi;
+            if (cls.contains((hi + 8) << 4 | lo))
+                highTable[lo] |= 1 << hi;
+        }
+    }
+}
+
+
+static size_t charRunScalar(unsigned char c, const unsigned char *data,
+                            size_t n) {
+    size_t i = 0;
+    while (i < n && data[i] == c)
+        i++;
+    return i;
+}
+
+
+static size_t classRunScalar(const ClassScanner &scanner,
+                             const unsigned char *data, size_t n) {
+    size_t i = 0;
+    while (i < n && scanner.cls.contains(data[i]))
+        i++;
+    return i;
+}
+
+
+#ifdef HAVE_X86_KERNELS
+
+__attribute__((target("sse4.2")))
+static size_t charRunSse42(unsigned char c, const unsigned char *data,
+                           size_t n) {
+    __m128i needle = _mm_set1_epi8((char) c);
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i *) (data + i));
+        unsigned mask = _mm_movemask_epi8(_mm_cmpeq_epi8(v, needle));
+        if (mask != 0xffff)
+            return i + __builtin_ctz(~mask);
+    }
+    return i + charRunScalar(c, data + i, n - i);
+}
+
+
+/* Returns a mask with a bit set for every byte of "v" that is NOT in the
+ * class, using the nibble tables described in simd.h.
+ */
+__attribute__((target("sse4.2")))
+static inline unsigned misses128(__m128i v, __m128i lowTable,
+                                 __m128i highTable, __m128i bitTable) {
+    __m128i highBit = _mm_set1_epi8((char) 0x80);
+    __m128i nibble = _mm_set1_epi8(0x0f);
+
+    // PSHUFB gives 0 for lanes with the top bit set, so each table only
+    // answers for its own half of the byte values.
+    __m128i found = _mm_or_si128(
+        _mm_shuffle_epi8(lowTable, v),
+        _mm_shuffle_epi8(highTable, _mm_xor_si128(v, highBit)));
+    __m128i hi = _mm_and_si128(_mm_srli_epi16(v, 4), nibble);
+    __m128i bit = _mm_shuffle_epi8(bitTable, hi);
+    __m128i hit = _mm_and_si128(found, bit);
+    return _mm_movemask_epi8(_mm_cmpeq_epi8(hit, _mm_setzero_si128()));
+}
+
+
+__attribute__((target("sse4.2")))
+static size_t classRunSse42(const ClassScanner &scanner,
+                            const unsigned char *data, size_t n) {
+    __m128i lowTable = _mm_loadu_si128((const __m128i *) scanner.lowTable);
+    __m128i highTable = _mm_loadu_si128((const __m128i *) scanner.highTable);
+    __m128i bitTable = _mm_setr_epi8(1, 2, 4, 8, 16, 32, 64, (char) 128,
+                                     1, 2, 4, 8, 16, 32, 64, (char) 128);
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i *) (data + i));
+        unsigned mask = misses128(v, lowTable, highTable, bitTable);
+        if (mask != 0)
+            return i + __builtin_ctz(mask);
+    }
+    return i + classRunScalar(scanner, data + i, n - i);
+}
+
+
+__attribute__((target("avx2")))
+static size_t charRunAvx2(unsigned char c, const unsigned char *data,
+                          size_t n) {
+    __m256i needle = _mm256_set1_epi8((char) c);
+    size_t i = 0;
+    for (; i + 32 <= n; i += 32) {
+        __m256i v = _mm256_loadu_si256((const __m256i *) (data + i));
+        unsigned mask = _mm256_movemask_epi8(_mm256_cmpeq_epi8(v, needle));
+        if (mask != 0xffffffffu)
+            return i + __builtin_ctz(~mask);
+    }
+    return i + charRunSse42(c, data + i, n - i);
+}
+
+
+__attribute__((target("avx2")))
+static size_t classRunAvx2(const ClassScanner &scanner,
+                           const unsigned char *data, size_t n) {
+    // VPSHUFB shuffles within each 128-bit lane, so both lanes get a copy
+    // of each table.
+    __m256i lowTable = _mm256_broadcastsi128_si256(
+        _mm_loadu_si128((const __m128i *) scanner.lowTable));
+    __m256i highTable = _mm256_broadcastsi128_si256(
+        _mm_loadu_si128((const __m128i *) scanner.highTable));
+    __m256i bitTable = _mm256_setr_epi8(
+        1, 2, 4, 8, 16, 32, 64, (char) 128, 1, 2, 4, 8, 16, 32, 64, (char) 128,
+        1, 2, 4, 8, 16, 32, 64, (char) 128, 1, 2, 4, 8, 16, 32, 64, (char) 128);
+    __m256i highBit = _mm256_set1_epi8((char) 0x80);
+    __m256i nibble = _mm256_set1_epi8(0x0f);
+
+    size_t i = 0;
+    for (; i + 32 <= n; i += 32) {
+        __m256i v = _mm256_loadu_si256((const __m256i *) (data + i));
+        __m256i found = _mm256_or_si256(
+            _mm256_shuffle_epi8(lowTable, v),
+            _mm256_shuffle_epi8(highTable, _mm256_xor_si256(v, highBit)));
+        __m256i hi = _mm256_and_si256(_mm256_srli_epi16(v, 4), nibble);
+        __m256i bit = _mm256_shuffle_epi8(bitTable, hi);
+        __m256i hit = _mm256_and_si256(found, bit);
+        unsigned mask = _mm256_movemask_epi8(
+            _mm256_cmpeq_epi8(hit, _mm256_setzero_si256()));
+        if (mask != 0)
+            return i + __builtin_ctz(mask);
+    }
+    return i + classRunSse42(scanner, data + i, n - i);
+}
+
+#endif // HAVE_X86_KERNELS
+
+
+/* Picks the best instruction set the CPU supports. */
+static SimdLevel detectSimdLevel() {
+#ifdef HAVE_X86_KERNELS
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+        return SIMD_AVX2;
+    if (__builtin_cpu_supports("sse4.2"))
+        return SIMD_SSE42;
+#endif
+    return SIMD_SCALAR;
+}
+
+
+static SimdLevel cpuLevel = detectSimdLevel();
+static SimdLevel activeLevel = cpuLevel;
+
+
+SimdLevel getSimdLevel() {
+    return activeLevel;
+}
+
+
+SimdLevel setSimdLevel(SimdLevel level) {
+    SimdLevel old = activeLevel;
+    activeLevel = level < cpuLevel ? level : cpuLevel;
+    return old;
+}
+
+
+size_t charRun(unsigned char c, const unsigned char *data, size_t n) {
+#ifdef HAVE_X86_KERNELS
+    // Short runs are not worth setting up the vector registers for.
+    if (n >= 16) {
+        if (activeLevel == SIMD_AVX2)
+            return charRunAvx2(c, data, n);
+        if (activeLevel == SIMD_SSE42)
+            return charRunSse42(c, data, n);
+    }
+#endif
+    return charRunScalar(c, data, n);
+}
+
+
+size_t classRun(const ClassScanner &scanner, const unsigned char *data,
+                size_t n) {
+#ifdef HAVE_X86_KERNELS
+    if (n >= 16) {
+        if (activeLevel == SIMD_AVX2)
+            return classRunAvx2(scanner, data, n);
+        if (activeLevel == SIMD_SSE42)
+            return classRunSse42(scanner, data, n);
+    }
+#endif
+    return classRunScalar(scanner, data, n);
+}
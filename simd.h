@@ -0,0 +1,46 @@
+#ifndef SIMD_HH
+#define SIMD_HH
+
+#include "./regex.h"
+
+#include <cstddef>
+
+
+/* A character class prepared for testing 16 or 32 bytes at a time.  Each
+ * byte is split into its low and high nibble; "lowTable" holds, for every
+ * low nibble, a bit for each high nibble 0-7 whose byte is in the class, and
+ * "highTable" does the same for high nibbles 8-15.  A byte shuffle
+ * (PSHUFB) then looks up 16 or 32 bytes in one instruction.
+ */
+struct ClassScanner {
+    CharClass cls;
+    uint8_t lowTable[16];
+    uint8_t highTable[16];
+
+    ClassScanner() { }
+    explicit ClassScanner(const CharClass &cls);
+};
+
+
+// The instruction sets the kernels can use, best last.
+enum SimdLevel {
+    SIMD_SCALAR,
+    SIMD_SSE42,
+    SIMD_AVX2
+};
+
+// Returns the instruction set the kernels use on this CPU.
+SimdLevel getSimdLevel();
+
+// Forces the kernels to use at most the given instruction set; used to test
+// the fallbacks.  Returns the level that was in use.
+SimdLevel setSimdLevel(SimdLevel level);
+
+// Returns how many bytes at the start of data[0, n) are equal to "c".
+size_t charRun(unsigned char c, const unsigned char *data, size_t n);
+
+// Returns how many bytes at the start of data[0, n) are in the class.
+size_t classRun(const ClassScanner &scanner, const unsigned char *data,
+                size_t n);
+
+#endif // SIMD_HH
@@ -0,0 +1,124 @@
+#include "stream.h"
+
+
+StreamMatcher::StreamMatcher(const CompiledRegex &regex) :
+    prog(regex.getForward()) {
+    reset();
+}
+
+
+void StreamMatcher::reset() {
+    scratch.clist.reserve(prog.insts.size());
+    scratch.nlist.reserve(prog.insts.size());
+    pos = 0;
+    length = 0;
+    kept.clear();
+    keptStart = 0;
+    pending = StreamRange();
+}
+
+
+/* Runs one step of the Pike VM at offset "pos", the same step pikeFind()
+ * takes at one index of a string.  "c" points to the byte at that offset, or
+ * is NULL at the end of the stream.
+ */
+void StreamMatcher::step(const char *c) {
+    ThreadList &clist = scratch.clist;
+    ThreadList &nlist = scratch.nlist;
+
+    if (pending.start == -1 && c != NULL)
+        addThread(prog, clist, scratch.stack, prog.start, pos);
+
+    for (int t = 0; t < clist.count(); t++) {
+        const NFAInst &inst = prog.insts[clist.pc(t)];
+
+        if (inst.opcode == NFA_BYTE) {
+            if (c != NULL && prog.classes[inst.cls].contains(*c))
+                addThread(prog, nlist, scratch.stack, inst.x, clist.start(t));
+        }
+        else if (inst.opcode == NFA_MATCH) {
+            pending = StreamRange(clist.start(t), pos);
+            break;
+        }
+    }
+
+    swap(clist, nlist);
+    nlist.clear();
+}
+
+
+/* Reports the match the current search has found, if any, and starts the
+ * next search where findAll() would: at the end of the match, or one byte
+ * further if the match is empty.  Returns false if there was no match.
+ */
+bool StreamMatcher::endMatch(vector<StreamRange> &matches) {
+    if (pending.start == -1)
+        return false;
+
+    matches.push_back(pending);
+    pos = pending.end > pending.start ? pending.end : pending.end + 1;
+    pending = StreamRange();
+    scratch.clist.clear();
+    return true;
+}
+
+
+/* Runs the VM from "pos" up to "dataEnd".  The bytes before "dataStart" come
+ * from the kept input and the rest from "data".  A search ends once it has
+ * found a match and no thread that could find a better one is left.
+ */
+void StreamMatcher::run(const char *data, long long dataStart,
+                        long long dataEnd, vector<StreamRange> &matches) {
+    while (pos < dataEnd) {
+        if (pos < dataStart)
+            step(&kept[pos - keptStart]);
+        else
+            step(data + (pos - dataStart));
+        pos++;
+
+        if (pending.start != -1 && scratch.clist.count() == 0)
+            endMatch(matches);
+    }
+}
+
+
+void StreamMatcher::feed(const char *data, size_t len,
+                         vector<StreamRange> &matches) {
+    long long dataStart = length;
+    length += len;
+    run(data, dataStart, length, matches);
+
+    // Only a pending match can send the search back, to the end of the
+    // match; every byte before that is done with.
+    long long keepFrom = pending.start != -1 ? pending.end : length;
+    if (keepFrom < dataStart) {
+        kept.erase(0, keepFrom - keptStart);
+        kept.append(data, len);
+    }
+    else {
+        kept.assign(data + (keepFrom - dataStart), length - keepFrom);
+    }
+    keptStart = keepFrom;
+}
+
+
+void StreamMatcher::feed(string_view chunk, vector<StreamRange> &matches) {
+    feed(chunk.data(), chunk.length(), matches);
+}
+
+
+void StreamMatcher::finish(vector<StreamRange> &matches) {
+    // Each match found at the end of the stream can send the search back
+    // into the kept bytes.
+    do {
+        run(NULL, length, length, matches);
+        step(NULL);
+    } while (endMatch(matches));
+
+    reset();
+}
+
+
+size_t StreamMatcher::getKeptBytes() const {
+    return kept.size();
+}
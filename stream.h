@@ -0,0 +1,67 @@
+#ifndef STREAM_HH
+#define STREAM_HH
+
+#include "./compiled.h"
+
+
+// A match found in a stream, as offsets from the start of the stream.  The
+// offsets are 64-bit, since a stream can be far longer than any string.
+typedef LongRange StreamRange;
+
+
+/* Finds the matches of a regex in input that arrives in chunks, such as a
+ * file read block by block or data from a socket.  The matches reported are
+ * the same as findAll() would report for the whole stream at once, even when
+ * a match crosses the boundary between two chunks.
+ *
+ * The matcher runs the Pike VM one byte at a time, keeping its threads from
+ * one chunk to the next.  Input is only copied when a match has been found
+ * but longer ones are still possible: if those fail, the search resumes
+ * from the end of the match, so the bytes after it are kept until then.
+ * Memory therefore stays bounded however long the stream is.
+ *
+ * The regex must outlive the matcher.
+ */
+class StreamMatcher {
+    const NFAProgram &prog;
+    PikeScratch scratch;
+
+    // The offset of the next byte to run the VM on.
+    long long pos;
+
+    // The offset just past the last byte fed in.
+    long long length;
+
+    // The bytes from offset "keptStart" to the end of the last chunk, which
+    // may have to be run again.
+    string kept;
+    long long keptStart;
+
+    // The best match found by the current search, if any.
+    StreamRange pending;
+
+    void step(const char *c);
+    bool endMatch(vector<StreamRange> &matches);
+    void run(const char *data, long long dataStart, long long dataEnd,
+             vector<StreamRange> &matches);
+
+public:
+    explicit StreamMatcher(const CompiledRegex &regex);
+
+    // Searches the next chunk of the stream, adding the matches that are
+    // now certain to "matches".
+    void feed(const char *data, size_t len, vector<StreamRange> &matches);
+    void feed(string_view chunk, vector<StreamRange> &matches);
+
+    // Ends the stream, adding the matches that remain to "matches".  The
+    // matcher is then ready for a new stream.
+    void finish(vector<StreamRange> &matches);
+
+    // Forgets the stream without reporting its remaining matches.
+    void reset();
+
+    // Returns how many bytes of input are being kept.
+    size_t getKeptBytes() const;
+};
+
+#endif // STREAM_HH
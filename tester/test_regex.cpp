@@ -1,9 +1,18 @@
 #include "testbase.h"
 #include "../engine.h"
+#include "../batch.h"
+#include "../ct_regex.h"
+#include "../regexcache.h"
+#include "../regexset.h"
+#include "../stream.h"
 
 #include <algorithm>
+#include <climits>
 #include <cstdlib>
 #include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <thread>
 
 
 using namespace std;
@@ -197,6 +206,58 @@ void test_inv_char_classes(TestContext &ctx) {
 }
 
 
+/*! Test ranges and escapes in character classes. */
+void test_class_bitmaps(TestContext &ctx) {
+    vector<RegexOperator *> regex = parseRegex("[a-zA-Z0-9_.-]+");
+    Range r;
+
+    ctx.DESC("Character classes with ranges");
+
+    r = find(regex, "  user.name-01@host");
+    ctx.CHECK(r.start == 2 && r.end == 14);
+
+    ctx.CHECK(match(regex, "Z_9.-a"));
+    ctx.CHECK(!match(regex, "a b"));
+
+    clearRegex(regex);
+
+    // Inverted classes understand ranges too.
+    regex = parseRegex("x[^a-c]y");
+
+    r = find(regex, "xbyxdy");
+    ctx.CHECK(r.start == 3 && r.end == 6);
+
+    ctx.CHECK(!match(regex, "xay"));
+    ctx.CHECK(!match(regex, "xcy"));
+    ctx.CHECK(match(regex, "x-y"));
+    ctx.CHECK(match(regex, "x\xe9" "y"));
+
+    ctx.result();
+
+    clearRegex(regex);
+
+    ctx.DESC("Escaped character classes");
+
+    regex = parseRegex("\\w+\\s\\d\\d");
+
+    r = find(regex, "at x_Y9 42!");
+    ctx.CHECK(r.start == 3 && r.end == 10);
+
+    ctx.CHECK(!match(regex, "ab 4x"));
+
+    clearRegex(regex);
+
+    regex = parseRegex("a.b");
+
+    ctx.CHECK(match(regex, "a\xff" "b"));
+    ctx.CHECK(match(regex, "a\nb"));
+
+    ctx.result();
+
+    clearRegex(regex);
+}
+
+
 /*! Test the * repeat-modifier. */
 void test_kleene_star(TestContext &ctx) {
     vector<RegexOperator *> regex = parseRegex("a.*c");
@@ -448,6 +509,1687 @@ void test_complex_regex(TestContext &ctx) {
 }
 
 
+/*! Test lowering the operators into a flat program. */
+void test_flat_program(TestContext &ctx) {
+    vector<RegexOperator *> regex = parseRegex("a\\d[0-9]x*.[^a]{2,3}[b]");
+    Program prog = compileProgram(regex);
+    clearRegex(regex);
+
+    ctx.DESC("Flat program from parsed operators");
+
+    ctx.CHECK(prog.size() == 7);
+
+    ctx.CHECK(prog[0].opcode == OP_CHAR && prog[0].arg == 'a');
+    ctx.CHECK(prog[3].opcode == OP_CHAR && prog[3].arg == 'x');
+    ctx.CHECK(prog[3].minRepeat == 0 && prog[3].maxRepeat == -1);
+    ctx.CHECK(prog[4].opcode == OP_ANY);
+    ctx.CHECK(prog[6].opcode == OP_CHAR && prog[6].arg == 'b');
+
+    // \d and [0-9] share one class.
+    ctx.CHECK(prog.getNumClasses() == 2);
+    ctx.CHECK(prog[1].opcode == OP_CLASS && prog[2].opcode == OP_CLASS);
+    ctx.CHECK(prog[1].arg == prog[2].arg);
+    ctx.CHECK(prog.matches(prog[1], '7') && !prog.matches(prog[1], 'x'));
+
+    ctx.CHECK(prog[5].opcode == OP_CLASS);
+    ctx.CHECK(prog[5].minRepeat == 2 && prog[5].maxRepeat == 3);
+    ctx.CHECK(!prog.matches(prog[5], 'a') && prog.matches(prog[5], 'b'));
+
+    ctx.result();
+}
+
+
+/*! A slow but simple reference matcher, independent of the engines: tries
+ *  every repeat count of every operator, most repeats first, and returns
+ *  where the first successful attempt ends, or -1.
+ */
+int reference_match_at(const vector<RegexOperator *> &regex, size_t k,
+                       const string &s, int pos) {
+    if (k == regex.size())
+        return pos;
+
+    const RegexOperator *op = regex[k];
+    int n = 0;
+    Range iter(pos, pos);
+    while (op->getMaxRepeat() == -1 || n < op->getMaxRepeat()) {
+        iter = Range(pos + n, pos + n);
+        if (!op->match(s, iter))
+            break;
+        n++;
+    }
+
+    for (; n >= op->getMinRepeat(); n--) {
+        int end = reference_match_at(regex, k + 1, s, pos + n);
+        if (end != -1)
+            return end;
+    }
+    return -1;
+}
+
+
+/*! The leftmost match starting at "from" or later, according to the
+ *  reference matcher.
+ */
+Range reference_find(const vector<RegexOperator *> &regex, const string &s,
+                     int from = 0) {
+    for (int i = from; i < (int) s.length(); i++) {
+        int end = reference_match_at(regex, 0, s, i);
+        if (end != -1)
+            return Range(i, end);
+    }
+    return Range(-1, -1);
+}
+
+
+/*! What match() should return, according to the reference matcher. */
+bool reference_match(const vector<RegexOperator *> &regex, const string &s) {
+    Range r = reference_find(regex, s);
+    return r.start == 0 && r.end == (int) s.length();
+}
+
+
+/*! Returns true if the engine agrees with the reference matcher on find()
+ *  and match() for every string in the table.
+ */
+bool engines_agree(const vector<RegexOperator *> &regex,
+                   const vector<string> &table, EngineType engine) {
+    for (const string &s : table) {
+        Range expected = reference_find(regex, s);
+        Range actual = find(regex, s, engine);
+        if (expected.start != actual.start || expected.end != actual.end)
+            return false;
+        if (reference_match(regex, s) != match(regex, s, engine))
+            return false;
+    }
+    return true;
+}
+
+
+/*! Returns true if the LazyDFA agrees with the reference matcher for every
+ *  string in the table.
+ */
+bool dfa_agrees(const vector<RegexOperator *> &regex,
+                const vector<string> &table, LazyDFA &dfa) {
+    for (const string &s : table) {
+        Range expected = reference_find(regex, s);
+        Range actual = dfa.find(s);
+        if (expected.start != actual.start || expected.end != actual.end)
+            return false;
+        if (reference_match(regex, s) != dfa.match(s))
+            return false;
+    }
+    return true;
+}
+
+
+/*! Returns every string of up to "maxLen" characters over the alphabet. */
+vector<string> all_strings(const string &alphabet, int maxLen) {
+    vector<string> table(1, "");
+    for (size_t i = 0; i < table.size(); i++) {
+        if ((int) table[i].length() == maxLen)
+            continue;
+        for (char c : alphabet)
+            table.push_back(table[i] + c);
+    }
+    return table;
+}
+
+
+/*! Test the Pike VM engine against the backtracking engine. */
+void test_pike_vm(TestContext &ctx) {
+    vector<RegexOperator *> regex = parseRegex("ab+c?d*[ef]+g[^ghi]*j.+k");
+    Range r;
+
+    ctx.DESC("Pike VM with find()");
+
+    r = find(regex, "abegjkk", ENGINE_PIKEVM);
+    ctx.CHECK(r.start == 0 && r.end == 7);
+
+    r = find(regex, "aaabbbbbbbbegjkk", ENGINE_PIKEVM);
+    ctx.CHECK(r.start == 2 && r.end == 16);
+
+    r = find(regex, "abegijkk", ENGINE_PIKEVM);
+    ctx.CHECK(r.start == -1 && r.end == -1);
+
+    r = find(regex, "", ENGINE_PIKEVM);
+    ctx.CHECK(r.start == -1 && r.end == -1);
+
+    ctx.result();
+
+    ctx.DESC("Pike VM with match()");
+
+    ctx.CHECK(match(regex, "abbbbbbbbegjkk", ENGINE_PIKEVM));
+    ctx.CHECK(!match(regex, "aaabegjkk", ENGINE_PIKEVM));
+    ctx.CHECK(!match(regex, "", ENGINE_PIKEVM));
+
+    ctx.result();
+
+    clearRegex(regex);
+
+    ctx.DESC("Pike VM agrees with backtracking");
+
+    const char *patterns[] = {
+        "abc", "a.c", "a[^b]c", "a*", "a*b", "a.*c", "a.+c", "ab?c",
+        "a?a?a", "a*a*b", "[ab]*b[ab]{2}", "b{2}a{1,3}", ".?a{0,2}b*",
+        "[a-b]+c*"
+    };
+    vector<string> table = all_strings("abc", 6);
+    for (const char *p : patterns) {
+        regex = parseRegex(p);
+        ctx.CHECK(engines_agree(regex, table, ENGINE_PIKEVM));
+        clearRegex(regex);
+    }
+
+    ctx.result();
+
+    ctx.DESC("Pike VM on pathological regex");
+
+    regex = parseRegex("a*a*a*a*a*b");
+    string s(5000, 'a');
+
+    r = find(regex, s, ENGINE_PIKEVM);
+    ctx.CHECK(r.start == -1 && r.end == -1);
+
+    r = find(regex, s + "b", ENGINE_PIKEVM);
+    ctx.CHECK(r.start == 0 && r.end == 5001);
+
+    ctx.result();
+
+    clearRegex(regex);
+}
+
+
+/*! Test the lazy DFA engine and its state cache. */
+void test_lazy_dfa(TestContext &ctx) {
+    vector<RegexOperator *> regex = parseRegex("ab+c?d*[ef]+g[^ghi]*j.+k");
+    Range r;
+
+    ctx.DESC("Lazy DFA with find() and match()");
+
+    r = find(regex, "aaabbbbbbbbegjkk", ENGINE_DFA);
+    ctx.CHECK(r.start == 2 && r.end == 16);
+
+    r = find(regex, "abegijkk", ENGINE_DFA);
+    ctx.CHECK(r.start == -1 && r.end == -1);
+
+    ctx.CHECK(match(regex, "abbbbbbbbegjkk", ENGINE_DFA));
+    ctx.CHECK(!match(regex, "aaabegjkk", ENGINE_DFA));
+    ctx.CHECK(!match(regex, "", ENGINE_DFA));
+
+    ctx.result();
+
+    clearRegex(regex);
+
+    ctx.DESC("Lazy DFA agrees with backtracking");
+
+    const char *patterns[] = {
+        "abc", "a.c", "a[^b]c", "a*", "a*b", "a.*c", "a.+c", "ab?c",
+        "a?a?a", "a*a*b", "[ab]*b[ab]{2}", "b{2}a{1,3}", ".?a{0,2}b*",
+        "[a-b]+c*"
+    };
+    vector<string> table = all_strings("abc", 6);
+    for (const char *p : patterns) {
+        regex = parseRegex(p);
+        ctx.CHECK(engines_agree(regex, table, ENGINE_DFA));
+        clearRegex(regex);
+    }
+
+    ctx.result();
+
+    ctx.DESC("Lazy DFA cache statistics");
+
+    regex = parseRegex("\\d{2,3}");
+    LazyDFA dfa(regex);
+
+    r = dfa.find("1000 or 10000?");
+    ctx.CHECK(r.start == 0 && r.end == 3);
+    ctx.CHECK(dfa.getStats().misses > 0);
+    ctx.CHECK(dfa.getStats().flushes == 0);
+
+    // The second search only takes transitions that are already cached.
+    long long misses = dfa.getStats().misses;
+    r = dfa.find("1000 or 10000?");
+    ctx.CHECK(r.start == 0 && r.end == 3);
+    ctx.CHECK(dfa.getStats().misses == misses);
+    ctx.CHECK(dfa.getStats().hits > 0);
+
+    dfa.resetStats();
+    ctx.CHECK(dfa.getStats().hits == 0 && dfa.getStats().misses == 0);
+
+    ctx.result();
+
+    clearRegex(regex);
+
+    ctx.DESC("Lazy DFA with a small cache");
+
+    regex = parseRegex("[ab]*a[ab]{3}c");
+    table = all_strings("abc", 7);
+
+    // Room for only a few states at a time: the cache is flushed often,
+    // and when it thrashes the search falls back to the Pike VM.
+    LazyDFA smallDfa(regex, 12 * 1024);
+    ctx.CHECK(dfa_agrees(regex, table, smallDfa));
+    ctx.CHECK(smallDfa.getStats().flushes > 0);
+
+    LazyDFA tinyDfa(regex, 2048);
+    ctx.CHECK(dfa_agrees(regex, table, tinyDfa));
+    ctx.CHECK(tinyDfa.getStats().fallbacks > 0);
+
+    ctx.result();
+
+    clearRegex(regex);
+}
+
+
+/*! Test finding the required literal of a regex. */
+void test_prefilter(TestContext &ctx) {
+    vector<RegexOperator *> regex;
+    Prefilter pf;
+
+    ctx.DESC("Required literal analysis");
+
+    regex = parseRegex("ERROR: \\d+");
+    pf = buildPrefilter(compileProgram(regex));
+    ctx.CHECK(pf.literal == "ERROR: ");
+    ctx.CHECK(pf.minOffset == 0 && pf.maxOffset == 0);
+    clearRegex(regex);
+
+    regex = parseRegex("\\d+ms timeout");
+    pf = buildPrefilter(compileProgram(regex));
+    ctx.CHECK(pf.literal == "ms timeout");
+    ctx.CHECK(pf.minOffset == 1 && pf.maxOffset == -1);
+    clearRegex(regex);
+
+    // The last two b's always come right before the "cd".
+    regex = parseRegex("x?ab{2,4}cd");
+    pf = buildPrefilter(compileProgram(regex));
+    ctx.CHECK(pf.literal == "bbcd");
+    ctx.CHECK(pf.minOffset == 1 && pf.maxOffset == 4);
+    clearRegex(regex);
+
+    regex = parseRegex("a*.?[xy]+");
+    pf = buildPrefilter(compileProgram(regex));
+    ctx.CHECK(pf.empty());
+    clearRegex(regex);
+
+    ctx.result();
+
+    ctx.DESC("Searching with a required literal");
+
+    CompiledRegex errors("ERROR: \\d+");
+    MatchScratch scratch;
+    Range r;
+
+    r = find(errors, "INFO: 12 ERROR 3 ERROR: 404 ERROR: 5", scratch);
+    ctx.CHECK(r.start == 17 && r.end == 27);
+
+    r = find(errors, "INFO: nothing to see here", scratch);
+    ctx.CHECK(r.start == -1 && r.end == -1);
+
+    r = find(errors, "ERROR: x ERROR: 1", scratch, ENGINE_PIKEVM);
+    ctx.CHECK(r.start == 9 && r.end == 17);
+
+    r = find(errors, "ERROR: x ERROR: 1", scratch, ENGINE_DFA);
+    ctx.CHECK(r.start == 9 && r.end == 17);
+
+    ctx.CHECK(match(errors, "ERROR: 42", scratch));
+    ctx.CHECK(!match(errors, "ERROR: 4x", scratch));
+
+    ctx.result();
+
+    ctx.DESC("Required literal agrees with reference");
+
+    const char *patterns[] = {
+        "ab", "b+a", "a?b{2,3}c*", "c*ab?ac", "[ab]*ba{2}", ".b{2}.",
+        "a{2,3}b+", "c.?a+b"
+    };
+    vector<string> table = all_strings("abc", 7);
+    for (const char *p : patterns) {
+        regex = parseRegex(p);
+        ctx.CHECK(!buildPrefilter(compileProgram(regex)).empty());
+        ctx.CHECK(engines_agree(regex, table, ENGINE_BACKTRACK));
+        ctx.CHECK(engines_agree(regex, table, ENGINE_PIKEVM));
+        ctx.CHECK(engines_agree(regex, table, ENGINE_DFA));
+        clearRegex(regex);
+    }
+
+    ctx.result();
+}
+
+
+/*! Returns true if the kernels find the same run lengths as a plain loop,
+ *  for runs that end at every position of a 100-byte buffer.
+ */
+bool kernels_agree(const CharClass &cls, unsigned char in, unsigned char out) {
+    ClassScanner scanner(cls);
+    for (int runLen = 0; runLen <= 100; runLen++) {
+        unsigned char data[100];
+        for (int i = 0; i < 100; i++)
+            data[i] = i < runLen ? in : out;
+
+        for (int n = 0; n <= 100; n += 7) {
+            size_t expected = runLen < n ? runLen : n;
+            if (classRun(scanner, data, n) != expected)
+                return false;
+            if (charRun(in, data, n) != expected)
+                return false;
+        }
+    }
+    return true;
+}
+
+
+/*! Test the SIMD kernels for greedy repetition. */
+void test_simd_kernels(TestContext &ctx) {
+    SimdLevel best = getSimdLevel();
+    SimdLevel levels[] = { SIMD_SCALAR, SIMD_SSE42, SIMD_AVX2 };
+
+    CharClass digits, notComma, high;
+    digits.addRange('0', '9');
+    notComma.add(',');
+    notComma.invert();
+    high.addRange(0x80, 0xff);
+    high.add(0x0f);
+
+    CompiledRegex regex("a[^,]*,\\d+");
+    MatchScratch scratch;
+    string field(1000, 'x');
+    string line = "a" + field + "\xe9,,a" + field + ",123" + field;
+
+    for (SimdLevel level : levels) {
+        setSimdLevel(level);
+
+        ctx.DESC(level == SIMD_SCALAR ? "Class runs with scalar code" :
+                 level == SIMD_SSE42 ? "Class runs with SSE4.2" :
+                 "Class runs with AVX2");
+
+        ctx.CHECK(kernels_agree(digits, '5', 'a'));
+        ctx.CHECK(kernels_agree(notComma, '\xff', ','));
+        ctx.CHECK(kernels_agree(notComma, 'q', ','));
+        ctx.CHECK(kernels_agree(high, 0x9a, 0x1a));
+        ctx.CHECK(kernels_agree(high, 0x0f, 0x7f));
+
+        Range r = find(regex, line, scratch);
+        ctx.CHECK(r.start == 1004 && r.end == 2009);
+
+        ctx.result();
+    }
+
+    setSimdLevel(best);
+}
+
+
+/*! Returns true if findAll() agrees with repeated reference searches for
+ *  every string in the table.
+ */
+bool find_all_agrees(const vector<RegexOperator *> &regex,
+                     const vector<string> &table, EngineType engine) {
+    CompiledRegex compiled(regex);
+    MatchScratch scratch;
+    for (const string &s : table) {
+        vector<Range> expected;
+        int pos = 0;
+        while (pos < (int) s.length()) {
+            Range r = reference_find(regex, s, pos);
+            if (r.start == -1)
+                break;
+            expected.push_back(r);
+            pos = r.end > r.start ? r.end : r.end + 1;
+        }
+
+        vector<Range> actual = findAll(compiled, s, scratch, engine);
+        if (actual.size() != expected.size())
+            return false;
+        for (size_t i = 0; i < actual.size(); i++) {
+            if (actual[i].start != expected[i].start ||
+                actual[i].end != expected[i].end)
+                return false;
+        }
+    }
+    return true;
+}
+
+
+/*! Test iterating over all the matches in a string. */
+void test_find_all(TestContext &ctx) {
+    MatchScratch scratch;
+    vector<Range> all;
+
+    ctx.DESC("findAll() and MatchIterator");
+
+    CompiledRegex digits("\\d+");
+    all = findAll(digits, "a1 22 333x", scratch);
+    ctx.CHECK(all.size() == 3);
+    ctx.CHECK(all[0].start == 1 && all[0].end == 2);
+    ctx.CHECK(all[1].start == 3 && all[1].end == 5);
+    ctx.CHECK(all[2].start == 6 && all[2].end == 9);
+
+    all = findAll(digits, "none here", scratch);
+    ctx.CHECK(all.empty());
+
+    // Empty matches are reported once each, and never overlap a match.
+    CompiledRegex as("a*");
+    all = findAll(as, "baab", scratch);
+    ctx.CHECK(all.size() == 3);
+    ctx.CHECK(all[0].start == 0 && all[0].end == 0);
+    ctx.CHECK(all[1].start == 1 && all[1].end == 3);
+    ctx.CHECK(all[2].start == 3 && all[2].end == 3);
+
+    string text = "GET /a 200, GET /b 404, GET /c 200";
+    CompiledRegex status("GET [^ ]+ 200");
+    MatchIterator iter(status, text, scratch);
+    Range r;
+    ctx.CHECK(iter.next(r) && r.start == 0 && r.end == 10);
+    ctx.CHECK(iter.next(r) && r.start == 24 && r.end == 34);
+    ctx.CHECK(!iter.next(r));
+    ctx.CHECK(!iter.next(r));
+
+    ctx.result();
+
+    ctx.DESC("findAll() agrees with reference");
+
+    const char *patterns[] = {
+        "a*", ".?b", "ab", "[ab]*c", "a?b?", "b+a{0,2}", "c.?a"
+    };
+    vector<string> table = all_strings("abc", 6);
+    for (const char *p : patterns) {
+        vector<RegexOperator *> regex = parseRegex(p);
+        ctx.CHECK(find_all_agrees(regex, table, ENGINE_BACKTRACK));
+        ctx.CHECK(find_all_agrees(regex, table, ENGINE_PIKEVM));
+        ctx.CHECK(find_all_agrees(regex, table, ENGINE_DFA));
+        clearRegex(regex);
+    }
+
+    ctx.result();
+}
+
+
+/* Returns true if the stream matcher reports the same matches as findAll()
+ * for every string in the table, whether it is fed as one chunk, split in
+ * two at any index, or fed one byte at a time.
+ */
+bool stream_agrees(const CompiledRegex &regex, const vector<string> &table) {
+    MatchScratch scratch;
+    StreamMatcher stream(regex);
+
+    for (const string &s : table) {
+        vector<Range> expected = findAll(regex, s, scratch);
+
+        vector<vector<string> > splits;
+        for (size_t k = 0; k <= s.length(); k++)
+            splits.push_back({s.substr(0, k), s.substr(k)});
+        vector<string> bytes;
+        for (char c : s)
+            bytes.push_back(string(1, c));
+        splits.push_back(bytes);
+
+        for (const vector<string> &chunks : splits) {
+            vector<StreamRange> found;
+            for (const string &chunk : chunks)
+                stream.feed(chunk, found);
+            stream.finish(found);
+
+            if (found.size() != expected.size())
+                return false;
+            for (size_t i = 0; i < found.size(); i++) {
+                if (found[i].start != expected[i].start ||
+                    found[i].end != expected[i].end)
+                    return false;
+            }
+        }
+    }
+    return true;
+}
+
+
+/*! Test matching a stream fed in chunks. */
+void test_streaming(TestContext &ctx) {
+    vector<StreamRange> found;
+
+    ctx.DESC("Stream matcher across chunk boundaries");
+
+    CompiledRegex status("GET [^ ]+ 200");
+    StreamMatcher stream(status);
+    stream.feed("GET /a 2", found);
+    ctx.CHECK(found.empty());
+    stream.feed("00, GET /b 404, GE", found);
+    ctx.CHECK(found.size() == 1);
+    ctx.CHECK(found[0].start == 0 && found[0].end == 10);
+    stream.feed("T /c 200", found);
+    stream.finish(found);
+    ctx.CHECK(found.size() == 2);
+    ctx.CHECK(found[1].start == 24 && found[1].end == 34);
+
+    // A match can only be reported once it cannot grow any longer.
+    CompiledRegex as("ba*");
+    StreamMatcher greedy(as);
+    found.clear();
+    greedy.feed("xbaa", found);
+    greedy.feed("aa", found);
+    ctx.CHECK(found.empty());
+    greedy.finish(found);
+    ctx.CHECK(found.size() == 1);
+    ctx.CHECK(found[0].start == 1 && found[0].end == 6);
+
+    ctx.result();
+
+    ctx.DESC("Stream matcher agrees with findAll()");
+
+    const char *patterns[] = {
+        "a*", ".?b", "ab", "[ab]*c", "a?b?", "b+a{0,2}", "c.?a", "ab?c?a"
+    };
+    vector<string> table = all_strings("abc", 5);
+    for (const char *p : patterns) {
+        CompiledRegex regex(p);
+        ctx.CHECK(stream_agrees(regex, table));
+    }
+
+    ctx.result();
+
+    ctx.DESC("Stream matcher memory stays bounded");
+
+    // Offsets keep counting across chunks, while only the bytes a pending
+    // match could still need are kept.
+    CompiledRegex words("ab+c?");
+    StreamMatcher longStream(words);
+    string chunk = string(4093, 'x') + "abb";
+    found.clear();
+    size_t maxKept = 0;
+    for (int i = 0; i < 1000; i++) {
+        longStream.feed(chunk, found);
+        maxKept = max(maxKept, longStream.getKeptBytes());
+    }
+    longStream.finish(found);
+    ctx.CHECK(found.size() == 1000);
+    ctx.CHECK(found[999].start == 999LL * 4096 + 4093);
+    ctx.CHECK(found[999].end == 1000LL * 4096);
+    ctx.CHECK(maxKept < 4);
+
+    ctx.result();
+}
+
+
+/*! Test searching for many regexes at once. */
+void test_regex_set(TestContext &ctx) {
+    ctx.DESC("RegexSet reports which patterns match");
+
+    RegexSet alerts({"ERROR", "timeout after \\d+ms", "disk [0-9]+% full",
+                     "user=root", "x*"});
+    ctx.CHECK(alerts.size() == 5);
+
+    vector<int> ids = alerts.matches("ERROR: timeout after 30ms, user=root");
+    ctx.CHECK(ids.size() == 4);
+    ctx.CHECK(ids[0] == 0 && ids[1] == 1 && ids[2] == 3 && ids[3] == 4);
+
+    ids = alerts.matches("disk 97% full");
+    ctx.CHECK(ids.size() == 2 && ids[0] == 2 && ids[1] == 4);
+
+    // Like find(), nothing matches an empty string.
+    ctx.CHECK(alerts.matches("").empty());
+
+    vector<SetMatch> where = alerts.find("user=root: ERROR");
+    ctx.CHECK(where.size() == 3);
+    ctx.CHECK(where[0].pattern == 0 && where[0].range.start == 11 &&
+              where[0].range.end == 16);
+    ctx.CHECK(where[1].pattern == 3 && where[1].range.start == 0 &&
+              where[1].range.end == 9);
+    ctx.CHECK(where[2].pattern == 4 && where[2].range.start == 0 &&
+              where[2].range.end == 0);
+
+    RegexSet none(vector<string>{});
+    ctx.CHECK(none.matches("abc").empty());
+
+    ctx.result();
+
+    ctx.DESC("RegexSet finds literal patterns with Aho-Corasick");
+
+    string literal;
+    CompiledRegex host("api.example.com");
+    CompiledRegex repeated("ab{3}c");
+    ctx.CHECK(!host.getProgram().isLiteral(literal));
+    ctx.CHECK(repeated.getProgram().isLiteral(literal) && literal == "abbbc");
+
+    RegexSet words({"he", "she", "his", "hers", "e", "she", "h.s"});
+    where = words.find("ushers");
+    ctx.CHECK(where.size() == 5);
+    ctx.CHECK(where[0].pattern == 0 && where[0].range.start == 2 &&
+              where[0].range.end == 4);
+    ctx.CHECK(where[1].pattern == 1 && where[1].range.start == 1 &&
+              where[1].range.end == 4);
+    ctx.CHECK(where[2].pattern == 3 && where[2].range.start == 2 &&
+              where[2].range.end == 6);
+    ctx.CHECK(where[3].pattern == 4 && where[3].range.start == 3 &&
+              where[3].range.end == 4);
+    ctx.CHECK(where[4].pattern == 5 && where[4].range.start == 1 &&
+              where[4].range.end == 4);
+
+    ids = words.matches("this");
+    ctx.CHECK(ids.size() == 2 && ids[0] == 2 && ids[1] == 6);
+
+    ctx.result();
+
+    ctx.DESC("RegexSet agrees with find()");
+
+    vector<string> patterns = {
+        "a*", ".?b", "ab", "[ab]*c", "a?b?", "b+a{0,2}", "c.?a", "cc", "[^a]b",
+        "a{2}c"
+    };
+    vector<string> table = all_strings("abc", 6);
+    bool agree = true;
+    for (size_t cacheBytes : {DFA_DEFAULT_CACHE_BYTES, (size_t) 8192}) {
+        RegexSet set(patterns, cacheBytes);
+        MatchScratch scratch;
+        for (const string &s : table) {
+            vector<SetMatch> found = set.find(s);
+            size_t next = 0;
+            for (int i = 0; i < set.size(); i++) {
+                Range r = find(set.getRegex(i), s, scratch);
+                if (r.start == -1)
+                    continue;
+                if (next == found.size() || found[next].pattern != i ||
+                    found[next].range.start != r.start ||
+                    found[next].range.end != r.end)
+                    agree = false;
+                next++;
+            }
+            if (next != found.size())
+                agree = false;
+        }
+    }
+    ctx.CHECK(agree);
+
+    ctx.result();
+}
+
+
+/*! Test the cache of compiled regexes. */
+void test_regex_cache(TestContext &ctx) {
+    MatchScratch scratch;
+
+    ctx.DESC("RegexCache hits, misses and evictions");
+
+    // One shard, so that the LRU order is easy to follow.
+    RegexCache cache(2, 1);
+    shared_ptr<const CompiledRegex> digits = cache.get("\\d+");
+    ctx.CHECK(cache.get("\\d+") == digits);
+    Range r = find(*digits, "ab123", scratch);
+    ctx.CHECK(r.start == 2 && r.end == 5);
+
+    cache.get("a+");
+    cache.get("\\d+");
+    cache.get("b+");
+    ctx.CHECK(cache.size() == 2);
+
+    RegexCacheStats stats = cache.getStats();
+    ctx.CHECK(stats.hits == 2 && stats.misses == 3 && stats.evictions == 1);
+
+    // "a+" was the least recently used.
+    cache.get("\\d+");
+    cache.get("b+");
+    ctx.CHECK(cache.getStats().misses == 3);
+    cache.get("a+");
+    ctx.CHECK(cache.getStats().misses == 4);
+
+    // An evicted regex stays usable while someone holds it.
+    cache.clear();
+    ctx.CHECK(cache.size() == 0);
+    ctx.CHECK(cache.get("\\d+") != digits);
+    r = find(*digits, "x9", scratch);
+    ctx.CHECK(r.start == 1 && r.end == 2);
+
+    cache.resetStats();
+    stats = cache.getStats();
+    ctx.CHECK(stats.hits == 0 && stats.misses == 0 && stats.evictions == 0);
+
+    ctx.result();
+
+    ctx.DESC("RegexCache shared between threads");
+
+    RegexCache shared(8, 4);
+    const int numThreads = 4;
+    vector<int> found(numThreads, 0);
+    vector<thread> threads;
+    for (int t = 0; t < numThreads; t++) {
+        threads.push_back(thread([&shared, &found, t]() {
+            MatchScratch scratch;
+            for (int i = 0; i < 1000; i++) {
+                string pattern = "a{" + to_string(i % 10) + "}b";
+                shared_ptr<const CompiledRegex> regex = shared.get(pattern);
+                string s = string(i % 10, 'a') + "b";
+                if (match(*regex, s, scratch))
+                    found[t]++;
+            }
+        }));
+    }
+    for (thread &t : threads)
+        t.join();
+
+    bool allFound = true;
+    for (int t = 0; t < numThreads; t++)
+        allFound = allFound && found[t] == 1000;
+    ctx.CHECK(allFound);
+    ctx.CHECK(shared.size() <= 8);
+    stats = shared.getStats();
+    ctx.CHECK(stats.hits + stats.misses == numThreads * 1000);
+    // Two threads can miss on the same pattern at once, and only one of
+    // their regexes is kept.
+    ctx.CHECK(stats.misses - stats.evictions >= (long long) shared.size());
+
+    ctx.result();
+}
+
+
+/* A memory resource that counts what goes through it. */
+class CountingResource : public pmr::memory_resource {
+public:
+    int allocated = 0;
+    int deallocated = 0;
+
+protected:
+    void *do_allocate(size_t bytes, size_t align) override {
+        allocated++;
+        return pmr::new_delete_resource()->allocate(bytes, align);
+    }
+
+    void do_deallocate(void *p, size_t bytes, size_t align) override {
+        deallocated++;
+        pmr::new_delete_resource()->deallocate(p, bytes, align);
+    }
+
+    bool do_is_equal(const pmr::memory_resource &other) const
+        noexcept override {
+        return this == &other;
+    }
+};
+
+
+/*! Test allocating parsed and compiled regexes from a memory resource. */
+void test_arena_allocation(TestContext &ctx) {
+    MatchScratch scratch;
+
+    ctx.DESC("Operators allocated from a memory resource");
+
+    // The operators and the vector, but not the sets, however long they are.
+    CountingResource counting;
+    pmr::vector<RegexOperator *> parsed =
+        parseRegex("ab+[cdefghijklmnopqrstuvwxyz]*\\d", &counting);
+    ctx.CHECK(parsed.size() == 4);
+    ctx.CHECK(counting.allocated == 5);
+    Range r = find(vector<RegexOperator *>(parsed.begin(), parsed.end()),
+                   "xabbc7");
+    ctx.CHECK(r.start == 1 && r.end == 6);
+    clearRegex(parsed, &counting);
+    ctx.CHECK(parsed.empty());
+    ctx.CHECK(counting.deallocated == 4);
+
+    vector<RegexOperator *> regex = parseRegex("a+b");
+    clearRegex(regex);
+    ctx.CHECK(regex.empty());
+
+    ctx.result();
+
+    ctx.DESC("CompiledRegex allocates from one resource");
+
+    CountingResource arena;
+    {
+        CompiledRegex compiled("ERROR: \\d+ms [a-z]+", &arena);
+        ctx.CHECK(arena.allocated > 0);
+        r = find(compiled, "x ERROR: 30ms ok", scratch);
+        ctx.CHECK(r.start == 2 && r.end == 16);
+        r = find(compiled, "x ERROR: 30ms ok", scratch, ENGINE_DFA);
+        ctx.CHECK(r.start == 2 && r.end == 16);
+    }
+    ctx.CHECK(arena.deallocated == arena.allocated);
+
+    // Many regexes can share an arena that is released in one go.
+    pmr::monotonic_buffer_resource shared;
+    bool allMatch = true;
+    for (int i = 0; i < 100; i++) {
+        CompiledRegex compiled("id=" + to_string(i) + "[a-z]?", &shared);
+        allMatch = allMatch &&
+            match(compiled, "id=" + to_string(i) + "x", scratch);
+    }
+    ctx.CHECK(allMatch);
+    shared.release();
+
+    ctx.result();
+}
+
+
+/*! Test matching batches of strings on a thread pool. */
+void test_batch(TestContext &ctx) {
+    ThreadPool pool(4);
+
+    ctx.DESC("Thread pool runs every index once");
+
+    for (size_t n : {(size_t) 0, (size_t) 1, (size_t) 63, (size_t) 1000}) {
+        vector<atomic<int> > runs(n);
+        pool.parallelFor(n, 16, [&](int w, size_t lo, size_t hi) {
+            if (w >= 0 && w < pool.size() && lo % 16 == 0 && hi - lo <= 16) {
+                for (size_t i = lo; i < hi; i++)
+                    runs[i]++;
+            }
+        });
+        bool once = true;
+        for (size_t i = 0; i < n; i++)
+            once = once && runs[i] == 1;
+        ctx.CHECK(once);
+    }
+
+    ctx.result();
+
+    ctx.DESC("Batch matching agrees with match() and find()");
+
+    // A few long inputs among many short ones.
+    vector<string> inputs;
+    for (int i = 0; i < 5000; i++) {
+        string s = "GET /item/" + to_string(i) + (i % 3 ? " 200" : " 404");
+        if (i % 997 == 0)
+            s = string(20000, 'x') + s;
+        inputs.push_back(s);
+    }
+
+    CompiledRegex regex("/item/\\d+ 200");
+    MatchScratch scratch;
+    for (EngineType engine : {ENGINE_BACKTRACK, ENGINE_PIKEVM, ENGINE_DFA}) {
+        MatchBitmap matched = matchBatch(regex, inputs, pool, engine);
+        vector<Range> found = findBatch(regex, inputs, pool, engine);
+        ctx.CHECK(matched.size() == inputs.size());
+        ctx.CHECK(found.size() == inputs.size());
+
+        bool agree = true;
+        size_t count = 0;
+        for (size_t i = 0; i < inputs.size(); i++) {
+            Range r = find(regex, inputs[i], scratch);
+            agree = agree && matched.test(i) == match(regex, inputs[i],
+                                                      scratch);
+            agree = agree && found[i].start == r.start &&
+                found[i].end == r.end;
+            count += found[i].start != -1;
+        }
+        ctx.CHECK(agree);
+        ctx.CHECK(count == 3333);
+        ctx.CHECK(matched.count() == 0);
+    }
+
+    CompiledRegex whole("GET /item/\\d+ 200");
+    ctx.CHECK(matchBatch(whole, inputs, pool).count() == 3329);
+    ctx.CHECK(matchBatch(whole, vector<string>(), pool).size() == 0);
+
+    // Lines sliced out of one buffer, without copying them.
+    string log;
+    for (size_t i = 0; i < inputs.size(); i++)
+        log += inputs[i] + "\n";
+    vector<string_view> lines;
+    for (size_t start = 0, eol; (eol = log.find('\n', start)) != string::npos;
+         start = eol + 1)
+        lines.push_back(string_view(log).substr(start, eol - start));
+    ctx.CHECK(lines.size() == inputs.size());
+    ctx.CHECK(matchBatch(whole, lines.data(), lines.size(), pool).count() ==
+              3329);
+    vector<Range> found = findBatch(regex, lines.data(), lines.size(), pool);
+    bool sameAsStrings = true;
+    for (size_t i = 0; i < inputs.size(); i++) {
+        Range r = find(regex, inputs[i], scratch);
+        sameAsStrings = sameAsStrings && found[i].start == r.start &&
+            found[i].end == r.end;
+    }
+    ctx.CHECK(sameAsStrings);
+
+    ctx.result();
+}
+
+
+/*! Test the backtracking engine with memoization of failed states. */
+void test_memoization(TestContext &ctx) {
+    vector<RegexOperator *> regex;
+    Range r;
+
+    ctx.DESC("Memoized backtracking agrees with reference");
+
+    const char *patterns[] = {
+        "abc", "a.c", "a[^b]c", "a*", "a*b", "a.*c", "a.+c", "ab?c",
+        "a?a?a", "a*a*b", "[ab]*b[ab]{2}", "b{2}a{1,3}", ".?a{0,2}b*",
+        "[a-b]+c*", "c*ab?ac"
+    };
+    vector<string> table = all_strings("abc", 6);
+    for (const char *p : patterns) {
+        regex = parseRegex(p);
+        ctx.CHECK(engines_agree(regex, table, ENGINE_BACKTRACK_MEMO));
+        ctx.CHECK(find_all_agrees(regex, table, ENGINE_BACKTRACK_MEMO));
+        clearRegex(regex);
+    }
+
+    ctx.result();
+
+    ctx.DESC("Memoized backtracking on pathological regex");
+
+    // Without memoization, each start index tries every way of splitting
+    // the rest of the string between the ten repeats.
+    CompiledRegex stars("a*a*a*a*a*a*a*a*a*a*[bc]");
+    MatchScratch scratch;
+    string s(2000, 'a');
+
+    r = find(stars, s, scratch, ENGINE_BACKTRACK_MEMO);
+    ctx.CHECK(r.start == -1 && r.end == -1);
+
+    r = find(stars, s + "c", scratch, ENGINE_BACKTRACK_MEMO);
+    ctx.CHECK(r.start == 0 && r.end == 2001);
+
+    // The same scratch starts each search with a clean record.
+    r = find(stars, "aab", scratch, ENGINE_BACKTRACK_MEMO);
+    ctx.CHECK(r.start == 0 && r.end == 3);
+    ctx.CHECK(findAll(stars, "xbab", scratch, ENGINE_BACKTRACK_MEMO).size()
+              == 2);
+
+    ctx.result();
+
+    ctx.DESC("Memoized backtracking falls back on large inputs");
+
+    // One bit per instruction and character would take more than
+    // BACKTRACK_MEMO_BYTES, so the Pike VM searches instead.
+    CompiledRegex longer("b\\d+c?d?e?f?g?h?i?x");
+    string big = string(BACKTRACK_MEMO_BYTES, 'a') + "b12x";
+    r = find(longer, big, scratch, ENGINE_BACKTRACK_MEMO);
+    ctx.CHECK(r.start == (int) BACKTRACK_MEMO_BYTES &&
+              r.end == (int) big.length());
+
+    r = find(longer, "ab1x", scratch, ENGINE_BACKTRACK_MEMO);
+    ctx.CHECK(r.start == 1 && r.end == 4);
+
+    ctx.result();
+}
+
+
+/*! Test the step budget and timeout of the backtracking engines. */
+void test_match_limits(TestContext &ctx) {
+    CompiledRegex regex("ab+c?d*[ef]+g[^ghi]*j.+k");
+    MatchScratch scratch;
+    MatchResult r;
+
+    ctx.DESC("Limits that are not reached");
+
+    r = find(regex, "aaabbbbbbbbegjkk", scratch, MatchLimits(1000));
+    ctx.CHECK(r.status == MATCH_FOUND);
+    ctx.CHECK(r.range.start == 2 && r.range.end == 16);
+    ctx.CHECK(r.steps > 0 && r.steps < 1000);
+
+    r = find(regex, "abegijkk", scratch, MatchLimits(1000));
+    ctx.CHECK(r.status == MATCH_NOT_FOUND);
+    ctx.CHECK(r.range.start == -1 && r.range.end == -1);
+
+    r = match(regex, "abbbbbbbbegjkk", scratch, MatchLimits(1000));
+    ctx.CHECK(r.status == MATCH_FOUND);
+    ctx.CHECK(r.range.start == 0 && r.range.end == 14);
+
+    r = match(regex, "aaabegjkk", scratch, MatchLimits(1000));
+    ctx.CHECK(r.status == MATCH_NOT_FOUND);
+
+    // No limits at all.
+    r = find(regex, "xabegjkk", scratch, MatchLimits());
+    ctx.CHECK(r.status == MATCH_FOUND && r.range.start == 1);
+
+    ctx.result();
+
+    ctx.DESC("Step budget on pathological regex");
+
+    CompiledRegex stars("a*a*a*a*a*a*a*a*a*a*[bc]");
+    string s(200, 'a');
+
+    r = find(stars, s, scratch, MatchLimits(10000));
+    ctx.CHECK(r.status == MATCH_STEP_LIMIT);
+    ctx.CHECK(r.range.start == -1 && r.range.end == -1);
+    ctx.CHECK(r.steps == 10000);
+
+    // Only failing takes long.
+    r = match(stars, s + "b", scratch, MatchLimits(10000));
+    ctx.CHECK(r.status == MATCH_FOUND && r.steps < 100);
+
+    // The linear time engines ignore the limits.
+    r = find(stars, s, scratch, MatchLimits(10000), ENGINE_PIKEVM);
+    ctx.CHECK(r.status == MATCH_NOT_FOUND && r.steps == 0);
+
+    r = find(stars, s + "b", scratch, MatchLimits(10000), ENGINE_DFA);
+    ctx.CHECK(r.status == MATCH_FOUND && r.range.end == 201);
+
+    // With memoization, the steps only grow with the square of the length.
+    r = find(stars, s, scratch, MatchLimits(1000000), ENGINE_BACKTRACK_MEMO);
+    ctx.CHECK(r.status == MATCH_NOT_FOUND);
+
+    ctx.result();
+
+    ctx.DESC("Timeout on pathological regex");
+
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    r = find(stars, s, scratch, MatchLimits(0, chrono::milliseconds(20)));
+    chrono::steady_clock::duration took = chrono::steady_clock::now() - start;
+
+    ctx.CHECK(r.status == MATCH_TIMEOUT);
+    ctx.CHECK(r.range.start == -1 && r.range.end == -1);
+    ctx.CHECK(took < chrono::seconds(2));
+
+    ctx.result();
+}
+
+
+/*! Records the events of the backtracking engine as short strings. */
+class RecordingTracer : public SearchTracer {
+public:
+    vector<string> events;
+
+    void onStart(const char *data, int len, int start) {
+        events.push_back("start " + to_string(start));
+    }
+
+    void onApply(int op, int pos, int count, bool success) {
+        events.push_back("apply " + to_string(op) + " " + to_string(pos) +
+                         " " + to_string(count) + (success ? "" : " fail"));
+    }
+
+    void onGiveBack(int op, int pos) {
+        events.push_back("give back " + to_string(op) + " " +
+                         to_string(pos));
+    }
+
+    void onUnapply(int op) {
+        events.push_back("unapply " + to_string(op));
+    }
+
+    void onEnd(Range r) {
+        events.push_back("end " + to_string(r.start) + " " +
+                         to_string(r.end));
+    }
+};
+
+
+/*! Test the search counters, per-pattern stats and tracers. */
+void test_instrumentation(TestContext &ctx) {
+    // [abc] and [cd] share a character, so the run of [abc] is split.
+    CompiledRegex regex("[abc]*[cd]");
+    MatchScratch scratch;
+    Range r;
+
+    ctx.DESC("Search counters");
+
+    // Off by default.
+    r = find(regex, "ab", scratch);
+    ctx.CHECK(r.start == -1);
+    ctx.CHECK(scratch.counters.searches == 0);
+    ctx.CHECK(regex.getStats().searches == 0);
+
+    // Each start tries [cd] after every split of the run of [abc].
+    scratch.counting = true;
+    r = find(regex, "ab", scratch);
+    ctx.CHECK(r.start == -1);
+    ctx.CHECK(scratch.counters.searches == 1);
+    ctx.CHECK(scratch.counters.startsTried == 2);
+    ctx.CHECK(scratch.counters.operatorsApplied == 7);
+    ctx.CHECK(scratch.counters.backtracks == 5);
+    ctx.CHECK(scratch.counters.bytesScanned == 3);
+
+    r = find(regex, "abc", scratch);
+    ctx.CHECK(r.start == 0 && r.end == 3);
+    ctx.CHECK(scratch.counters.startsTried == 1);
+    ctx.CHECK(scratch.counters.operatorsApplied == 3);
+    ctx.CHECK(scratch.counters.backtracks == 1);
+
+    // The linear time engines only count searches.
+    r = find(regex, "ab", scratch, ENGINE_PIKEVM);
+    ctx.CHECK(scratch.counters.searches == 1);
+    ctx.CHECK(scratch.counters.operatorsApplied == 0);
+
+    ctx.result();
+
+    ctx.DESC("Per-pattern stats");
+
+    SearchCounters total = regex.getStats();
+    ctx.CHECK(total.searches == 3);
+    ctx.CHECK(total.startsTried == 3);
+    ctx.CHECK(total.operatorsApplied == 10);
+    ctx.CHECK(total.backtracks == 6);
+
+    // Threads sharing the regex add to the same stats.
+    regex.resetStats();
+    vector<thread> threads;
+    for (int t = 0; t < 4; t++) {
+        threads.push_back(thread([&regex]() {
+            MatchScratch own;
+            own.counting = true;
+            for (int i = 0; i < 100; i++)
+                findAll(regex, "ab c abd", own);
+        }));
+    }
+    for (thread &t : threads)
+        t.join();
+    ctx.CHECK(regex.getStats().searches == 4 * 100 * 2);
+
+    regex.resetStats();
+    ctx.CHECK(regex.getStats().searches == 0);
+
+    ctx.result();
+
+    ctx.DESC("Tracers");
+
+    CompiledRegex plus("a+b");
+    RecordingTracer recorder;
+    scratch.counting = false;
+    scratch.tracer = &recorder;
+
+    r = find(plus, "aab", scratch);
+    ctx.CHECK(r.start == 0 && r.end == 3);
+    vector<string> expected = {
+        "start 0", "apply 0 0 2", "apply 1 2 1", "end 0 3"
+    };
+    ctx.CHECK(recorder.events == expected);
+
+    recorder.events.clear();
+    r = find(regex, "b", scratch);
+    expected = {
+        "start 0", "apply 0 0 1", "apply 1 1 0 fail", "give back 0 0",
+        "apply 1 0 0 fail", "unapply 0", "end -1 -1"
+    };
+    ctx.CHECK(recorder.events == expected);
+
+    ostringstream out;
+    StreamTracer printer(out);
+    scratch.tracer = &printer;
+    find(plus, "aab", scratch);
+    ctx.CHECK(out.str().find("Match succeeded on range [0, 3)") !=
+              string::npos);
+
+    scratch.tracer = NULL;
+
+    ctx.result();
+}
+
+
+/*! Test that match() only tries index 0, and only accepts a match that
+ *  ends at the end of the string.
+ */
+void test_anchored_match(TestContext &ctx) {
+    CompiledRegex digits("\\d+");
+    CompiledRegex stars("a*b?");
+    CompiledRegex empty("");
+    MatchScratch scratch;
+
+    ctx.DESC("Anchored match()");
+
+    for (EngineType engine : {ENGINE_BACKTRACK, ENGINE_BACKTRACK_MEMO,
+                              ENGINE_PIKEVM, ENGINE_DFA}) {
+        ctx.CHECK(match(digits, "20260314", scratch, engine));
+        ctx.CHECK(!match(digits, "x20260314", scratch, engine));
+        ctx.CHECK(!match(digits, "20260314x", scratch, engine));
+        ctx.CHECK(!match(digits, "", scratch, engine));
+
+        ctx.CHECK(match(stars, "aaab", scratch, engine));
+        ctx.CHECK(match(stars, "b", scratch, engine));
+        ctx.CHECK(!match(stars, "aaba", scratch, engine));
+        ctx.CHECK(!match(stars, "aac", scratch, engine));
+
+        // The empty regex only matches the empty string, which match()
+        // never accepts.
+        ctx.CHECK(!match(empty, "abc", scratch, engine));
+    }
+    ctx.CHECK(!match(parseRegex(""), "abc"));
+
+    ctx.result();
+
+    ctx.DESC("Anchored match() tries one start index");
+
+    // find() would try every index of the field before giving up.
+    string field = string(1000, '7') + "x";
+    scratch.counting = true;
+    ctx.CHECK(!match(digits, field, scratch));
+    ctx.CHECK(scratch.counters.startsTried == 1);
+
+    ctx.CHECK(!match(stars, string(1000, 'a') + "c", scratch,
+                     ENGINE_BACKTRACK_MEMO));
+    ctx.CHECK(scratch.counters.startsTried == 1);
+    scratch.counting = false;
+
+    MatchResult r = match(digits, field, scratch, MatchLimits(10));
+    ctx.CHECK(r.status == MATCH_NOT_FOUND);
+    r = match(digits, field.substr(0, 1000), scratch, MatchLimits(10));
+    ctx.CHECK(r.status == MATCH_FOUND);
+    ctx.CHECK(r.range.start == 0 && r.range.end == 1000);
+
+    ctx.result();
+}
+
+
+/*! Returns true if StaticRegex agrees with the runtime engine on find()
+ *  and match() for every string in the table.
+ */
+template <FixedString Pattern>
+bool static_agrees(const vector<string> &table) {
+    CompiledRegex regex(Pattern.chars);
+    MatchScratch scratch;
+    for (const string &s : table) {
+        Range expected = find(regex, s, scratch);
+        Range actual = StaticRegex<Pattern>::find(s);
+        if (expected.start != actual.start || expected.end != actual.end)
+            return false;
+        if (match(regex, s, scratch) != StaticRegex<Pattern>::match(s))
+            return false;
+    }
+    return true;
+}
+
+
+/*! Test regexes parsed and specialized at compile time. */
+void test_static_regex(TestContext &ctx) {
+    ctx.DESC("Patterns parsed at compile time");
+
+    static_assert(StaticRegex<"abc">::size() == 3);
+    static_assert(StaticRegex<"a{2,3}[^b]*\\d+\\.">::size() == 4);
+    static_assert(StaticRegex<"a{x">::size() == 3);
+
+    constexpr auto prog = parseStatic(FixedString("a?[a-c]"));
+    static_assert(prog.size == 2);
+    static_assert(prog.ops[0].minRepeat == 0 && prog.ops[0].maxRepeat == 1);
+    static_assert(prog.ops[1].cls.isRange() && prog.ops[1].cls.lowest() == 'a'
+                  && prog.ops[1].cls.highest() == 'c');
+
+    Range r = StaticRegex<"ab+c?d*[ef]+g[^ghi]*j.+k">::find("aaabbbbbbbbegjkk");
+    ctx.CHECK(r.start == 2 && r.end == 16);
+    ctx.CHECK(StaticRegex<"\\d{4}-\\d\\d-\\d\\d">::match("2026-03-14"));
+    ctx.CHECK(!StaticRegex<"\\d{4}-\\d\\d-\\d\\d">::match("2026-03-1x"));
+    ctx.CHECK(!StaticRegex<"a*">::match(""));
+
+    ctx.result();
+
+    ctx.DESC("Static regexes agree with the runtime engine");
+
+    vector<string> table = all_strings("abc", 6);
+    ctx.CHECK(static_agrees<"abc">(table));
+    ctx.CHECK(static_agrees<"a.c">(table));
+    ctx.CHECK(static_agrees<"a[^b]c">(table));
+    ctx.CHECK(static_agrees<"a*b">(table));
+    ctx.CHECK(static_agrees<"a.*c">(table));
+    ctx.CHECK(static_agrees<"a?a?a">(table));
+    ctx.CHECK(static_agrees<"[ab]*b[ab]{2}">(table));
+    ctx.CHECK(static_agrees<"b{2}a{1,3}">(table));
+    ctx.CHECK(static_agrees<".?a{0,2}b*">(table));
+    ctx.CHECK(static_agrees<"[a-b]+c*">(table));
+    ctx.CHECK(static_agrees<"c*ab?ac">(table));
+    ctx.CHECK(static_agrees<"a{c">(table));
+
+    ctx.result();
+}
+
+
+/*! Returns true if the program compiled to machine code agrees with the
+ *  Pike VM on find() and match() for every string in the table.
+ */
+bool jit_agrees(const string &pattern, const vector<string> &table) {
+    CompiledRegex regex(pattern);
+    JitProgram jit(regex.getProgram());
+    MatchScratch scratch;
+    vector<RunState> runs(regex.getProgram().size());
+    if (!jit.ok())
+        return false;
+
+    for (const string &s : table) {
+        Range expected = find(regex, s, scratch, ENGINE_PIKEVM);
+        Range actual(-1, -1);
+        for (int i = 0; i < (int) s.length() && actual.start == -1; i++) {
+            int end = jit.matchAt(s.data(), s.length(), i, false,
+                                  runs.data());
+            if (end != -1)
+                actual = Range(i, end);
+        }
+        if (expected.start != actual.start || expected.end != actual.end)
+            return false;
+
+        bool matched = !s.empty() &&
+            jit.matchAt(s.data(), s.length(), 0, true, runs.data()) != -1;
+        if (match(regex, s, scratch, ENGINE_PIKEVM) != matched)
+            return false;
+    }
+    return true;
+}
+
+
+/*! Test regexes compiled to machine code. */
+void test_jit(TestContext &ctx) {
+    if (!JitProgram::isSupported())
+        return;
+
+    ctx.DESC("Compiled programs agree with the Pike VM");
+
+    vector<string> table = all_strings("abc", 6);
+    for (const char *pattern : {"abc", "a.c", "a[^b]c", "a*b", "a.*c",
+                                "a?a?a", "[ac]*b[ab]{2}", "b{2}a{1,3}",
+                                ".?a{0,2}b*", "[a-b]+c*", "c*ab?ac",
+                                "a{2,9}c?", "[ac]+", "[^c]*b"})
+        ctx.CHECK(jit_agrees(pattern, table));
+
+    // Long runs, through the unrolled loops and back.
+    vector<string> lines;
+    srand(22);
+    for (int i = 0; i < 200; i++) {
+        string line;
+        int len = rand() % 80;
+        for (int k = 0; k < len; k++)
+            line += "aab,"[rand() % 4];
+        lines.push_back(line);
+    }
+    for (const char *pattern : {"[^,]*,", "a+b", "[ab]*,a", ".*b,", "\\w+"})
+        ctx.CHECK(jit_agrees(pattern, lines));
+    ctx.CHECK(jit_agrees("", table));
+
+    ctx.result();
+
+    ctx.DESC("Hot regexes are compiled");
+
+    CompiledRegex regex("a+b");
+    MatchScratch scratch;
+    Range r;
+    for (long long i = 1; i < JIT_THRESHOLD_CALLS; i++)
+        find(regex, "xaab", scratch);
+    ctx.CHECK(regex.getJit() == NULL);
+
+    // Counting searches and other engines keep interpreting.
+    scratch.counting = true;
+    find(regex, "xaab", scratch);
+    scratch.counting = false;
+    find(regex, "xaab", scratch, ENGINE_PIKEVM);
+    ctx.CHECK(regex.getJit() == NULL);
+
+    r = find(regex, "xaab", scratch);
+    ctx.CHECK(regex.getJit() != NULL);
+    ctx.CHECK(r.start == 1 && r.end == 4);
+    r = find(regex, "xaabaaab", scratch);
+    ctx.CHECK(r.start == 1 && r.end == 4);
+    r = find(regex, "aaaa", scratch);
+    ctx.CHECK(r.start == -1 && r.end == -1);
+    ctx.CHECK(match(regex, "aab", scratch));
+    ctx.CHECK(!match(regex, "aaba", scratch));
+
+    ctx.result();
+
+    ctx.DESC("Long patterns are compiled");
+
+    // The runs live in the scratch, so a pattern with more operators than
+    // would fit in a stack frame still runs once it is compiled.
+    // The prefilter turns down "b" at once, but the searches still count.
+    string text(600000, 'a');
+    CompiledRegex longRegex(text);
+    for (long long i = 0; i < JIT_THRESHOLD_CALLS; i++)
+        find(longRegex, "b", scratch);
+    ctx.CHECK(longRegex.getJit() != NULL);
+
+    r = find(longRegex, "b" + text, scratch);
+    ctx.CHECK(r.start == 1 && r.end == 600001);
+    ctx.CHECK(match(longRegex, text, scratch));
+    ctx.CHECK(!match(longRegex, text.substr(1), scratch));
+
+    ctx.result();
+}
+
+
+/*! Test that repeats which cannot help by giving back characters are
+ *  made possessive, without changing any results.
+ */
+void test_possessive(TestContext &ctx) {
+    ctx.DESC("Repeats are marked possessive");
+
+    CompiledRegex words("[a-z]+\\d+");
+    CompiledRegex units("\\d+ms");
+    CompiledRegex overlap("a*a");
+    CompiledRegex skipped("a?b?a");
+    CompiledRegex optional("a*b?");
+    CompiledRegex fixed("a{2}b");
+
+    ctx.CHECK(words.getProgram()[0].flags & INST_POSSESSIVE);
+    ctx.CHECK(units.getProgram()[0].flags & INST_POSSESSIVE);
+    ctx.CHECK(!(overlap.getProgram()[0].flags & INST_POSSESSIVE));
+    ctx.CHECK(!(skipped.getProgram()[0].flags & INST_POSSESSIVE));
+    ctx.CHECK(skipped.getProgram()[1].flags & INST_POSSESSIVE);
+    ctx.CHECK(optional.getProgram()[0].flags & INST_POSSESSIVE);
+    ctx.CHECK(!(fixed.getProgram()[0].flags & INST_POSSESSIVE));
+
+    ctx.result();
+
+    ctx.DESC("Possessive repeats give the same results");
+
+    vector<string> table = all_strings("abc", 6);
+    for (const char *pattern : {"a*b", "a+b+c", "[ab]*c", "a?b?a", "a*b?",
+                                "b*a{0,2}c", "[^a]*a", "a*[bc]*a", ".*c",
+                                "c?a+b*c?"}) {
+        CompiledRegex regex(pattern);
+        MatchScratch scratch;
+        bool same = true;
+        for (const string &s : table) {
+            Range expected = find(regex, s, scratch, ENGINE_PIKEVM);
+            bool matched = match(regex, s, scratch, ENGINE_PIKEVM);
+            for (EngineType engine : {ENGINE_BACKTRACK,
+                                      ENGINE_BACKTRACK_MEMO}) {
+                Range r = find(regex, s, scratch, engine);
+                if (r.start != expected.start || r.end != expected.end ||
+                    match(regex, s, scratch, engine) != matched)
+                    same = false;
+            }
+        }
+        ctx.CHECK(same);
+    }
+
+    ctx.result();
+
+    ctx.DESC("Possessive repeats are not split");
+
+    // Each start with a digit un-applies "m" and then the whole run of
+    // digits, instead of retrying "m" after every shorter run.
+    MatchScratch scratch;
+    scratch.counting = true;
+    Range r = find(units, "1234567890m ms", scratch);
+    ctx.CHECK(r.start == -1);
+    ctx.CHECK(scratch.counters.startsTried == 12);
+    ctx.CHECK(scratch.counters.backtracks == 20);
+
+    ctx.result();
+}
+
+
+/*! Test that the backtracking engine keeps one count per instruction,
+ *  however long the runs it backtracks through.
+ */
+void test_run_state(TestContext &ctx) {
+    ctx.DESC("Backtracking through long runs");
+
+    CompiledRegex regex("a.*b[^c]*c?x");
+    MatchScratch scratch;
+    string text = "a" + string(200000, 'b') + "cx" + string(1000, 'y');
+
+    // .* takes the whole string, then gives back one character at a time
+    // until the rest matches.
+    Range r = find(regex, text, scratch);
+    Range expected = find(regex, text, scratch, ENGINE_PIKEVM);
+    ctx.CHECK(r.start == expected.start && r.end == expected.end);
+    ctx.CHECK(r.start == 0 && r.end == 200003);
+    ctx.CHECK(scratch.runs.size() == 6);
+
+    ctx.CHECK(match(regex, text.substr(0, 200003), scratch));
+    ctx.CHECK(!match(regex, text.substr(0, 300), scratch));
+    ctx.CHECK(scratch.runs.size() == 6);
+
+    ctx.result();
+}
+
+
+/*! Test searching string_views and raw buffers in place, and the
+ *  64-bit ranges of findLong().
+ */
+void test_string_views(TestContext &ctx) {
+    CompiledRegex regex("\\d+ms");
+    MatchScratch scratch;
+
+    ctx.DESC("Searching string_views and buffers");
+
+    // Offsets are relative to the start of the slice.
+    string buffer = "GET /a 12ms; GET /b 340ms; GET /c 7ms";
+    string_view second = string_view(buffer).substr(12, 13);
+    Range r = find(regex, second, scratch);
+    ctx.CHECK(r.start == 8 && r.end == 13);
+    ctx.CHECK(find(regex, "took 5ms", scratch).start == 5);
+
+    ctx.CHECK(match(regex, string_view(buffer).substr(20, 5), scratch));
+    ctx.CHECK(!match(regex, string_view(buffer).substr(20, 6), scratch));
+    ctx.CHECK(match(regex, buffer.data() + 7, 4, scratch));
+    ctx.CHECK(!match(regex, buffer.data() + 7, 5, scratch));
+
+    vector<Range> all = findAll(regex, string_view(buffer).substr(5), scratch);
+    ctx.CHECK(all.size() == 3);
+    ctx.CHECK(all[2].start == 29 && all[2].end == 32);
+
+    ctx.result();
+
+    ctx.DESC("Ranges with 64-bit offsets");
+
+    LongRange lr = findLong(regex, buffer, scratch);
+    ctx.CHECK(lr.start == 7 && lr.end == 11);
+    lr = findLong(regex, "no times", scratch, ENGINE_DFA);
+    ctx.CHECK(lr.start == -1 && lr.end == -1);
+
+    // The Pike VM that searches longer strings agrees with the int one.
+    vector<string> table = all_strings("abc", 6);
+    bool same = true;
+    for (const char *pattern : {"a*b", "[ab]?c+", "a.*c", "b{2}a?"}) {
+        CompiledRegex other(pattern);
+        for (const string &s : table) {
+            Range expected = pikeFind(other.getForward(), s);
+            LongRange actual = pikeFindLong(other.getForward(), s.data(),
+                                            s.length(), scratch.pike);
+            if (actual.start != expected.start || actual.end != expected.end)
+                same = false;
+        }
+    }
+    ctx.CHECK(same);
+
+    vector<LongRange> longAll = findAllLong(regex, buffer, scratch);
+    vector<Range> intAll = findAll(regex, buffer, scratch);
+    ctx.CHECK(longAll.size() == 3 && intAll.size() == 3);
+    for (size_t i = 0; i < longAll.size() && i < intAll.size(); i++)
+        ctx.CHECK(longAll[i].start == intAll[i].start &&
+                  longAll[i].end == intAll[i].end);
+
+    // Strings an int cannot index are turned down before they are read.
+    string_view huge(buffer.data(), (size_t) INT_MAX + 1);
+    int rejected = 0;
+    try {
+        find(regex, huge, scratch);
+    } catch (length_error &) {
+        rejected++;
+    }
+    try {
+        findAll(regex, huge, scratch);
+    } catch (length_error &) {
+        rejected++;
+    }
+    try {
+        find(regex, huge, scratch, MatchLimits(100));
+    } catch (length_error &) {
+        rejected++;
+    }
+    ctx.CHECK(rejected == 3);
+
+    // Bytes that cannot start a match are skipped while no thread is alive.
+    CompiledRegex skip("a*b");
+    CharClass first;
+    first.add('a');
+    first.add('b');
+    lr = pikeFindLong(skip.getForward(), "ccacab", 6, scratch.pike, 0, &first);
+    ctx.CHECK(lr.start == 4 && lr.end == 6);
+
+    ctx.result();
+}
+
+
+/*! Test one CompiledRegex shared between threads. */
+void test_compiled_regex(TestContext &ctx) {
+    CompiledRegex regex("ab+c?d*[ef]+g[^ghi]*j.+k");
+    MatchScratch scratch;
+    Range r;
+
+    ctx.DESC("CompiledRegex with find() and match()");
+
+    r = find(regex, "aaabbbbbbbbegjkk", scratch);
+    ctx.CHECK(r.start == 2 && r.end == 16);
+
+    r = find(regex, "abegijkk", scratch);
+    ctx.CHECK(r.start == -1 && r.end == -1);
+
+    ctx.CHECK(match(regex, "abegjkk", scratch));
+    ctx.CHECK(!match(regex, "aaabegjkk", scratch));
+
+    r = find(regex, "aaabbbbbbbbegjkk", scratch, ENGINE_PIKEVM);
+    ctx.CHECK(r.start == 2 && r.end == 16);
+
+    r = find(regex, "aaabbbbbbbbegjkk", scratch, ENGINE_DFA);
+    ctx.CHECK(r.start == 2 && r.end == 16);
+
+    // Searching part of a buffer in place never looks past its end.
+    const char *buffer = "xxabegjkk|abegjkk";
+    for (EngineType engine : {ENGINE_BACKTRACK, ENGINE_PIKEVM, ENGINE_DFA}) {
+        r = find(regex, buffer, 9, scratch, engine);
+        ctx.CHECK(r.start == 2 && r.end == 9);
+        r = find(regex, buffer + 9, 8, scratch, engine);
+        ctx.CHECK(r.start == 1 && r.end == 8);
+        r = find(regex, buffer, 8, scratch, engine);
+        ctx.CHECK(r.start == -1 && r.end == -1);
+    }
+
+    ctx.result();
+
+    ctx.DESC("One scratch used with several regexes");
+
+    CompiledRegex other("\\d{2,3}");
+
+    r = find(other, "1000 or 10000?", scratch, ENGINE_DFA);
+    ctx.CHECK(r.start == 0 && r.end == 3);
+
+    r = find(regex, "abegjkk", scratch, ENGINE_DFA);
+    ctx.CHECK(r.start == 0 && r.end == 7);
+
+    r = find(other, "x 12", scratch);
+    ctx.CHECK(r.start == 2 && r.end == 4);
+
+    ctx.result();
+
+    ctx.DESC("CompiledRegex shared between threads");
+
+    vector<string> table = all_strings("abegjk", 5);
+    for (string &s : table)
+        s = "abb" + s + "jkk";
+
+    vector<Range> expected;
+    for (const string &s : table)
+        expected.push_back(find(regex, s, scratch));
+
+    const int numThreads = 4;
+    vector<int> failures(numThreads, 0);
+    vector<thread> threads;
+    for (int t = 0; t < numThreads; t++) {
+        threads.push_back(thread([&, t]() {
+            MatchScratch local;
+            EngineType engine = (EngineType) (t % 3);
+            for (size_t i = 0; i < table.size(); i++) {
+                Range r = find(regex, table[i], local, engine);
+                if (r.start != expected[i].start || r.end != expected[i].end)
+                    failures[t]++;
+            }
+        }));
+    }
+    for (thread &th : threads)
+        th.join();
+
+    for (int t = 0; t < numThreads; t++)
+        ctx.CHECK(failures[t] == 0);
+
+    ctx.result();
+}
+
+
 /*! This program is a simple test-suite for the Rational class. */
 int main() {
   
@@ -459,10 +2201,32 @@ int main() {
     test_simple_wildcards(ctx);
     test_char_classes(ctx);
     test_inv_char_classes(ctx);
+    test_class_bitmaps(ctx);
     test_kleene_star(ctx);
     test_plus(ctx);
     test_optional(ctx);
     test_complex_regex(ctx);
+    test_flat_program(ctx);
+    test_pike_vm(ctx);
+    test_lazy_dfa(ctx);
+    test_prefilter(ctx);
+    test_simd_kernels(ctx);
+    test_compiled_regex(ctx);
+    test_find_all(ctx);
+    test_streaming(ctx);
+    test_regex_set(ctx);
+    test_regex_cache(ctx);
+    test_arena_allocation(ctx);
+    test_batch(ctx);
+    test_memoization(ctx);
+    test_match_limits(ctx);
+    test_instrumentation(ctx);
+    test_anchored_match(ctx);
+    test_static_regex(ctx);
+    test_jit(ctx);
+    test_possessive(ctx);
+    test_run_state(ctx);
+    test_string_views(ctx);
     
     // Return 0 if everything passed, nonzero if something failed.
     return !ctx.ok();
@@ -0,0 +1,192 @@
+#include "threadpool.h"
+
+
+ThreadPool::ThreadPool(int numThreads) :
+    body(NULL), grain(1), loopId(0), active(0), stopping(false),
+    remaining(0), idle(0) {
+    if (numThreads <= 0)
+        numThreads = thread::hardware_concurrency();
+    if (numThreads <= 0)
+        numThreads = 1;
+
+    for (int w = 0; w < numThreads; w++)
+        workers.push_back(unique_ptr<Worker>(new Worker()));
+    for (int w = 0; w < numThreads; w++)
+        threads.push_back(thread(&ThreadPool::workerMain, this, w));
+}
+
+
+ThreadPool::~ThreadPool() {
+    {
+        lock_guard<mutex> guard(state);
+        stopping = true;
+    }
+    changed.notify_all();
+    for (size_t w = 0; w < threads.size(); w++)
+        threads[w].join();
+}
+
+
+int ThreadPool::size() const {
+    return workers.size();
+}
+
+
+/* Waits for each new loop, and helps to run it. */
+void ThreadPool::workerMain(int w) {
+    int seen = 0;
+    while (true) {
+        {
+            unique_lock<mutex> guard(state);
+            changed.wait(guard, [&]() {
+                return stopping || loopId != seen;
+            });
+            if (stopping)
+                return;
+            seen = loopId;
+            active++;
+        }
+
+        runLoop(w);
+
+        lock_guard<mutex> guard(state);
+        active--;
+        changed.notify_all();
+    }
+}
+
+
+/* Takes a range to work on: the most recently queued one of this worker,
+ * which is the smallest and the most likely to be in its cache, or failing
+ * that the oldest, largest one of another worker.
+ */
+bool ThreadPool::takeWork(int w, WorkRange &range) {
+    {
+        Worker &own = *workers[w];
+        lock_guard<mutex> guard(own.lock);
+        if (!own.queue.empty()) {
+            range = own.queue.back();
+            own.queue.pop_back();
+            return true;
+        }
+    }
+
+    int n = workers.size();
+    for (int i = 1; i < n; i++) {
+        Worker &victim = *workers[(w + i) % n];
+        lock_guard<mutex> guard(victim.lock);
+        if (!victim.queue.empty()) {
+            range = victim.queue.front();
+            victim.queue.pop_front();
+            return true;
+        }
+    }
+    return false;
+}
+
+
+bool ThreadPool::hasQueuedWork() {
+    for (size_t w = 0; w < workers.size(); w++) {
+        lock_guard<mutex> guard(workers[w]->lock);
+        if (!workers[w]->queue.empty())
+            return true;
+    }
+    return false;
+}
+
+
+void ThreadPool::runLoop(int w) {
+    Worker &own = *workers[w];
+    WorkRange range;
+
+    while (remaining.load() > 0) {
+        if (!takeWork(w, range)) {
+            // The rest of the loop is being run by others, who may still
+            // split off some of it.  They signal "changed" when they do, or
+            // when the loop ends.
+            unique_lock<mutex> guard(state);
+            idle++;
+            changed.wait(guard, [&]() {
+                return remaining.load() == 0 || hasQueuedWork();
+            });
+            idle--;
+            continue;
+        }
+
+        while (range.lo < range.hi) {
+            // Offer half of the rest to the other workers, unless some of
+            // this worker's work is already waiting to be stolen.
+            if (range.hi - range.lo >= 2 * grain) {
+                bool queued = false;
+                {
+                    lock_guard<mutex> guard(own.lock);
+                    if (own.queue.empty()) {
+                        size_t half = (range.hi - range.lo) / 2;
+                        size_t mid =
+                            range.lo + (half + grain - 1) / grain * grain;
+                        WorkRange rest = { mid, range.hi };
+                        own.queue.push_back(rest);
+                        range.hi = mid;
+                        queued = true;
+                    }
+                }
+
+                // An idle worker counts itself before it looks at the
+                // queues, so either it sees this range or it is woken here.
+                if (queued && idle.load() > 0) {
+                    lock_guard<mutex> guard(state);
+                    changed.notify_all();
+                }
+            }
+
+            size_t end = range.lo + grain < range.hi ?
+                range.lo + grain : range.hi;
+            (*body)(w, range.lo, end);
+
+            if (remaining.fetch_sub(end - range.lo) == end - range.lo) {
+                lock_guard<mutex> guard(state);
+                changed.notify_all();
+            }
+            range.lo = end;
+        }
+    }
+}
+
+
+void ThreadPool::parallelFor(size_t n, size_t grain,
+                             const function<void(int, size_t, size_t)> &body) {
+    if (n == 0)
+        return;
+    if (grain == 0)
+        grain = 1;
+
+    lock_guard<mutex> loop(loopLock);
+
+    // Give each worker an equal share to start with.
+    size_t numGrains = (n + grain - 1) / grain;
+    size_t numWorkers = workers.size();
+    for (size_t w = 0; w < numWorkers; w++) {
+        size_t lo = numGrains * w / numWorkers * grain;
+        size_t hi = numGrains * (w + 1) / numWorkers * grain;
+        if (hi > n)
+            hi = n;
+        if (lo < hi) {
+            WorkRange range = { lo, hi };
+            lock_guard<mutex> guard(workers[w]->lock);
+            workers[w]->queue.push_back(range);
+        }
+    }
+
+    unique_lock<mutex> guard(state);
+    this->body = &body;
+    this->grain = grain;
+    remaining = n;
+    loopId++;
+    changed.notify_all();
+
+    // Wait until every index has run and every worker has left the loop,
+    // so that none of them still looks at it when the next one starts.
+    changed.wait(guard, [&]() {
+        return remaining.load() == 0 && active == 0;
+    });
+}
@@ -0,0 +1,83 @@
+#ifndef THREADPOOL_HH
+#define THREADPOOL_HH
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+
+/* A fixed set of worker threads that run parallel loops with work stealing.
+ *
+ * parallelFor() starts each worker on an equal share of the index range.
+ * A worker works through its range "grain" indexes at a time, and whenever
+ * its own queue is empty it splits off the second half of what is left and
+ * queues it.  Workers that run out of work steal queued halves from the
+ * others.  Ranges are only split while someone may need the work, so a
+ * uniform loop runs in a few large pieces, while a skewed one, where some
+ * indexes take far longer than others, is split as finely as it needs to
+ * keep every worker busy.
+ */
+class ThreadPool {
+    struct WorkRange {
+        size_t lo, hi;
+    };
+
+    struct Worker {
+        mutex lock;
+        deque<WorkRange> queue;
+    };
+
+    vector<unique_ptr<Worker> > workers;
+    vector<thread> threads;
+
+    // Only one loop runs at a time.
+    mutex loopLock;
+
+    // The current loop.  "state" guards the fields below it, and "changed"
+    // is signalled whenever they change.
+    mutex state;
+    condition_variable changed;
+    const function<void(int, size_t, size_t)> *body;
+    size_t grain;
+    int loopId;
+    int active;
+    bool stopping;
+
+    // The number of indexes of the current loop not yet run.
+    atomic<size_t> remaining;
+
+    // The number of workers waiting on "changed" for work to steal.
+    atomic<int> idle;
+
+    void workerMain(int w);
+    void runLoop(int w);
+    bool takeWork(int w, WorkRange &range);
+    bool hasQueuedWork();
+
+public:
+    // Starts the threads; by default, one per core.
+    explicit ThreadPool(int numThreads = 0);
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool &) = delete;
+    ThreadPool &operator=(const ThreadPool &) = delete;
+
+    int size() const;
+
+    // Calls body(worker, lo, hi) on pieces [lo, hi) of the range [0, n),
+    // and returns once all of them have run.  Pieces start at multiples of
+    // "grain" and are at most "grain" long; "worker" is the index of the
+    // thread running the piece, from 0 to size() - 1.
+    void parallelFor(size_t n, size_t grain,
+                     const function<void(int, size_t, size_t)> &body);
+};
+
+#endif // THREADPOOL_HH
@@ -0,0 +1,540 @@
+/* regex_bench: measures how fast the engines search generated corpora.
+ *
+ *   regex_bench [-f text|csv|json] [-E engine] [-s kilobytes] [-t seconds]
+ *               [-p filter]
+ *
+ *   -f  the output format (default: text)
+ *   -E  only run one engine: backtrack, memo, pikevm or dfa (default: all)
+ *   -s  the size of each corpus in kilobytes (default: 1024)
+ *   -t  how long to run each case for, at least (default: 0.5)
+ *   -p  only run the cases whose name contains this string
+ *
+ * A "find" case searches each line of a corpus for all of the matches of
+ * one pattern; a "match" case calls match() once per line, to check whether
+ * the whole line matches.  Every call to find() or match() is timed on its
+ * own, so that the report can give the throughput (MB/s and matches per
+ * second), the median and 99th percentile latency of a call, and the number
+ * of heap allocations per call.  The corpora are generated from a fixed seed, so runs of
+ * different builds search the same bytes and their CSV or JSON output can
+ * be compared line by line.
+ */
+
+#include "../engine.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+
+#include <unistd.h>
+
+
+// Every heap allocation in the process goes through these, so the number
+// made during a call to find() or match() is the change in this counter.
+static atomic<long long> allocations(0);
+
+void *operator new(size_t size) {
+    allocations.fetch_add(1, memory_order_relaxed);
+    void *p = malloc(size ? size : 1);
+    if (!p)
+        throw bad_alloc();
+    return p;
+}
+
+void operator delete(void *p) noexcept {
+    free(p);
+}
+
+void operator delete(void *p, size_t) noexcept {
+    free(p);
+}
+
+
+/* A small deterministic random generator (xorshift64), so that every run
+ * generates the same corpora.
+ */
+class Random {
+    uint64_t state;
+
+public:
+    explicit Random(uint64_t seed) : state(seed) { }
+
+    uint64_t next() {
+        state ^= state << 13;
+        state ^= state >> 7;
+        state ^= state << 17;
+        return state;
+    }
+
+    int below(int n) {
+        return next() % n;
+    }
+
+    const char *pick(const char *const *words, int n) {
+        return words[below(n)];
+    }
+};
+
+
+struct Corpus {
+    string name;
+    vector<string> lines;
+    size_t bytes;
+};
+
+
+struct Case {
+    const char *corpus;
+    const char *name;
+
+    // "find" or "match".
+    const char *call;
+
+    const char *pattern;
+};
+
+
+struct Result {
+    string corpus;
+    string name;
+    const char *call;
+    string pattern;
+    const char *engine;
+    size_t bytes;
+    long long calls;
+    long long matches;
+    double seconds;
+    double p50;
+    double p99;
+    double allocsPerCall;
+};
+
+
+static const char *const WORDS[] = {
+    "the", "quick", "brown", "fox", "jumps", "over", "lazy", "dog", "while",
+    "reading", "about", "quantum", "mechanics", "and", "walking", "through",
+    "quiet", "gardens", "beautiful", "queueing", "of", "a", "in", "is",
+    "running", "system", "engine", "pattern", "matching", "string"
+};
+static const int NUM_WORDS = sizeof(WORDS) / sizeof(WORDS[0]);
+
+static const char *const LEVELS[] = {
+    "INFO", "INFO", "INFO", "DEBUG", "WARN", "ERROR"
+};
+static const char *const METHODS[] = { "GET", "GET", "POST", "PUT" };
+static const char *const PATHS[] = {
+    "users", "orders", "items", "sessions", "search"
+};
+static const char *const CITIES[] = {
+    "Springfield", "Riverside", "Fairview", "Madison", "Georgetown"
+};
+
+
+static void addLine(Corpus &corpus, const string &line) {
+    corpus.lines.push_back(line);
+    corpus.bytes += line.size();
+}
+
+
+/* Web server logs, such as
+ * "2026-03-14 08:15:42.123 INFO [worker-7] GET /api/v2/users/48213 200 12ms"
+ * with the occasional timeout.
+ */
+static Corpus makeLogs(size_t bytes, Random &rng) {
+    Corpus corpus = { "logs", vector<string>(), 0 };
+    char line[256];
+    while (corpus.bytes < bytes) {
+        const char *level = rng.pick(LEVELS, 6);
+        int n = snprintf(line, sizeof(line),
+                         "2026-%02d-%02d %02d:%02d:%02d.%03d %s [worker-%d] "
+                         "%s /api/v%d/%s/%d %d %dms",
+                         1 + rng.below(12), 1 + rng.below(28), rng.below(24),
+                         rng.below(60), rng.below(60), rng.below(1000), level,
+                         rng.below(16), rng.pick(METHODS, 4), 1 + rng.below(2),
+                         rng.pick(PATHS, 5), rng.below(100000),
+                         strcmp(level, "ERROR") == 0 ? 500 : 200,
+                         rng.below(2000));
+        string s(line, n);
+        if (strcmp(level, "ERROR") == 0 && rng.below(4) == 0)
+            s += " upstream timeout";
+        addLine(corpus, s);
+    }
+    return corpus;
+}
+
+
+/* CSV records of "id,email,city,date,amount". */
+static Corpus makeCsv(size_t bytes, Random &rng) {
+    Corpus corpus = { "csv", vector<string>(), 0 };
+    char line[256];
+    while (corpus.bytes < bytes) {
+        int n = snprintf(line, sizeof(line),
+                         "%d,%s.%s@example.com,%s,%d-%02d-%02d,%d.%02d",
+                         rng.below(1000000), rng.pick(WORDS, NUM_WORDS),
+                         rng.pick(WORDS, NUM_WORDS), rng.pick(CITIES, 5),
+                         2010 + rng.below(16), 1 + rng.below(12),
+                         1 + rng.below(28), rng.below(10000), rng.below(100));
+        addLine(corpus, string(line, n));
+    }
+    return corpus;
+}
+
+
+/* Lines of ten random English words. */
+static Corpus makeText(size_t bytes, Random &rng) {
+    Corpus corpus = { "text", vector<string>(), 0 };
+    while (corpus.bytes < bytes) {
+        string line;
+        for (int i = 0; i < 10; i++) {
+            if (i > 0)
+                line += ' ';
+            line += rng.pick(WORDS, NUM_WORDS);
+        }
+        addLine(corpus, line);
+    }
+    return corpus;
+}
+
+
+/* 80 column lines of random bases, over a four letter alphabet. */
+static Corpus makeDna(size_t bytes, Random &rng) {
+    Corpus corpus = { "dna", vector<string>(), 0 };
+    while (corpus.bytes < bytes) {
+        string line(80, 'A');
+        for (int i = 0; i < 80; i++)
+            line[i] = "ACGT"[rng.below(4)];
+        addLine(corpus, line);
+    }
+    return corpus;
+}
+
+
+/* Short runs of a single character, which make a backtracking engine try
+ * every way of splitting the run between the repeats of a pattern before
+ * it fails.  Kept small, since those can take exponential time.
+ */
+static Corpus makeRepeats(size_t bytes, Random &rng) {
+    Corpus corpus = { "repeats", vector<string>(), 0 };
+    bytes /= 64;
+    while (corpus.bytes < bytes)
+        addLine(corpus, string(16 + rng.below(8), 'a'));
+    return corpus;
+}
+
+
+static const Case CASES[] = {
+    { "logs",    "literal",     "find",   "ERROR" },
+    { "logs",    "absent",      "find",   "FATAL" },
+    { "logs",    "class",       "find",   "\\d{4}-\\d\\d-\\d\\d \\d\\d:\\d\\d" },
+    { "logs",    "dotstar",     "find",   ".*ERROR.*timeout" },
+    { "logs",    "nested",      "find",   "worker-\\d+. [A-Z]+ /\\w+/v\\d/\\w+/\\d+" },
+    { "logs",    "line",        "match",  "\\d{4}-\\d\\d-\\d\\d \\d\\d:\\d\\d:\\d\\d\\.\\d+ [A-Z]+ .*ms" },
+    { "logs",    "error",       "match",  ".*ERROR.*" },
+    { "csv",     "literal",     "find",   "@example\\.com" },
+    { "csv",     "class",       "find",   "[a-z]+\\.[a-z]+@" },
+    { "csv",     "dotstar",     "find",   ".*,.*,.*,2019" },
+    { "csv",     "nested",      "find",   "\\d+,[^,]*,[^,]*,\\d{4}-\\d\\d" },
+    { "csv",     "row",         "match",  "\\d+,[a-z]+\\.[a-z]+@example\\.com,[A-Za-z]+,\\d{4}-\\d\\d-\\d\\d,\\d+\\.\\d\\d" },
+    { "csv",     "2019",        "match",  ".*,.*,.*,2019.*" },
+    { "text",    "literal",     "find",   "quantum" },
+    { "text",    "class",       "find",   "[aeiou]{3}" },
+    { "text",    "dotstar",     "find",   "the.*fox.*dog" },
+    { "text",    "nested",      "find",   "\\w+\\s+\\w+ing" },
+    { "dna",     "literal",     "find",   "GATTACA" },
+    { "dna",     "class",       "find",   "[AT]{6}" },
+    { "dna",     "dotstar",     "find",   "TATA.*GCGC" },
+    { "dna",     "nested",      "find",   "A+C+G+T+" },
+    { "repeats", "stars",       "find",   "a*a*a*a*a*[bc]" },
+    { "repeats", "optionals",   "find",   "a?a?a?a?a?a?a?a?aaaaaaaa[bc]" },
+    { "repeats", "dotstars",    "find",   ".*.*.*.*[bc]" },
+    { "repeats", "stars",       "match",  "a*a*a*a*a*[bc]" },
+};
+static const int NUM_CASES = sizeof(CASES) / sizeof(CASES[0]);
+
+
+static const char *engineName(EngineType engine) {
+    switch (engine) {
+    case ENGINE_BACKTRACK_MEMO:
+        return "memo";
+    case ENGINE_PIKEVM:
+        return "pikevm";
+    case ENGINE_DFA:
+        return "dfa";
+    default:
+        return "backtrack";
+    }
+}
+
+
+/* Returns the given percentile of the sorted latencies. */
+static double percentile(const vector<double> &sorted, double p) {
+    if (sorted.empty())
+        return 0;
+    size_t i = (size_t) (p * (sorted.size() - 1) + 0.5);
+    return sorted[i];
+}
+
+
+/* Runs one case until it has taken at least minSeconds, after one pass
+ * that warms the caches and the DFA.
+ */
+static Result runCase(const Corpus &corpus, const Case &c, EngineType engine,
+                      double minSeconds) {
+    typedef chrono::steady_clock Clock;
+
+    CompiledRegex regex(c.pattern);
+    MatchScratch scratch;
+
+    Result result;
+    result.corpus = corpus.name;
+    result.name = c.name;
+    result.call = c.call;
+    result.pattern = c.pattern;
+    result.engine = engineName(engine);
+    result.bytes = 0;
+    result.calls = 0;
+    result.matches = 0;
+    result.seconds = 0;
+
+    vector<double> latencies;
+    long long allocs = 0;
+    bool wholeLines = strcmp(c.call, "match") == 0;
+
+    for (int pass = 0; pass == 0 || result.seconds < minSeconds; pass++) {
+        bool warmup = pass == 0;
+        for (size_t i = 0; i < corpus.lines.size(); i++) {
+            const char *data = corpus.lines[i].data();
+            int len = corpus.lines[i].size();
+
+            if (wholeLines) {
+                long long before = allocations.load(memory_order_relaxed);
+                Clock::time_point start = Clock::now();
+                bool matched = match(regex, string_view(data, len), scratch,
+                                     engine);
+                Clock::time_point end = Clock::now();
+                long long after = allocations.load(memory_order_relaxed);
+
+                if (!warmup) {
+                    double ns = chrono::duration<double, nano>(
+                        end - start).count();
+                    latencies.push_back(ns);
+                    result.seconds += ns / 1e9;
+                    result.calls++;
+                    result.matches += matched;
+                    allocs += after - before;
+                    result.bytes += len;
+                }
+                continue;
+            }
+
+            // Step through the matches of the line the same way
+            // MatchIterator does.
+            int pos = 0;
+            while (pos < len) {
+                long long before = allocations.load(memory_order_relaxed);
+                Clock::time_point start = Clock::now();
+                Range r = find(regex, data + pos, len - pos, scratch, engine);
+                Clock::time_point end = Clock::now();
+                long long after = allocations.load(memory_order_relaxed);
+
+                if (!warmup) {
+                    double ns = chrono::duration<double, nano>(
+                        end - start).count();
+                    latencies.push_back(ns);
+                    result.seconds += ns / 1e9;
+                    result.calls++;
+                    allocs += after - before;
+                }
+
+                if (r.start == -1)
+                    break;
+                if (!warmup)
+                    result.matches++;
+                pos += r.end > r.start ? r.end : r.start + 1;
+            }
+            if (!warmup)
+                result.bytes += len;
+        }
+    }
+
+    sort(latencies.begin(), latencies.end());
+    result.p50 = percentile(latencies, 0.50);
+    result.p99 = percentile(latencies, 0.99);
+    result.allocsPerCall = result.calls ? (double) allocs / result.calls : 0;
+    return result;
+}
+
+
+static double mbPerSecond(const Result &r) {
+    return r.seconds > 0 ? r.bytes / r.seconds / 1e6 : 0;
+}
+
+
+static double matchesPerSecond(const Result &r) {
+    return r.seconds > 0 ? r.matches / r.seconds : 0;
+}
+
+
+/* Prints a string as a JSON or CSV string literal. */
+static void printQuoted(const string &s, bool json) {
+    putchar('"');
+    for (size_t i = 0; i < s.size(); i++) {
+        if (json && (s[i] == '"' || s[i] == '\\'))
+            putchar('\\');
+        else if (!json && s[i] == '"')
+            putchar('"');
+        putchar(s[i]);
+    }
+    putchar('"');
+}
+
+
+static void printText(const vector<Result> &results) {
+    printf("%-8s %-10s %-6s %-10s %10s %12s %10s %10s %8s\n", "corpus",
+           "case", "call", "engine", "MB/s", "matches/s", "p50 ns", "p99 ns",
+           "allocs");
+    for (size_t i = 0; i < results.size(); i++) {
+        const Result &r = results[i];
+        printf("%-8s %-10s %-6s %-10s %10.1f %12.0f %10.0f %10.0f %8.2f\n",
+               r.corpus.c_str(), r.name.c_str(), r.call, r.engine,
+               mbPerSecond(r),
+               matchesPerSecond(r), r.p50, r.p99, r.allocsPerCall);
+    }
+}
+
+
+static void printCsv(const vector<Result> &results) {
+    printf("corpus,case,call,pattern,engine,bytes,calls,matches,seconds,"
+           "mb_per_s,matches_per_s,p50_ns,p99_ns,allocs_per_call\n");
+    for (size_t i = 0; i < results.size(); i++) {
+        const Result &r = results[i];
+        printf("%s,%s,%s,", r.corpus.c_str(), r.name.c_str(), r.call);
+        printQuoted(r.pattern, false);
+        printf(",%s,%zu,%lld,%lld,%.6f,%.3f,%.1f,%.1f,%.1f,%.4f\n", r.engine,
+               r.bytes, r.calls, r.matches, r.seconds, mbPerSecond(r),
+               matchesPerSecond(r), r.p50, r.p99, r.allocsPerCall);
+    }
+}
+
+
+static void printJson(const vector<Result> &results) {
+    printf("[\n");
+    for (size_t i = 0; i < results.size(); i++) {
+        const Result &r = results[i];
+        printf("  {\"corpus\": \"%s\", \"case\": \"%s\", \"call\": \"%s\", "
+               "\"pattern\": ", r.corpus.c_str(), r.name.c_str(), r.call);
+        printQuoted(r.pattern, true);
+        printf(", \"engine\": \"%s\", \"bytes\": %zu, \"calls\": %lld, "
+               "\"matches\": %lld, \"seconds\": %.6f, \"mb_per_s\": %.3f, "
+               "\"matches_per_s\": %.1f, \"p50_ns\": %.1f, \"p99_ns\": %.1f, "
+               "\"allocs_per_call\": %.4f}%s\n", r.engine, r.bytes, r.calls,
+               r.matches, r.seconds, mbPerSecond(r), matchesPerSecond(r),
+               r.p50, r.p99, r.allocsPerCall,
+               i + 1 < results.size() ? "," : "");
+    }
+    printf("]\n");
+}
+
+
+static void usage() {
+    fprintf(stderr, "usage: regex_bench [-f text|csv|json] "
+            "[-E backtrack|memo|pikevm|dfa] [-s kilobytes] [-t seconds] "
+            "[-p filter]\n");
+    exit(2);
+}
+
+
+int main(int argc, char **argv) {
+    const char *format = "text";
+    vector<EngineType> engines;
+    size_t corpusBytes = 1024 << 10;
+    double minSeconds = 0.5;
+    const char *filter = NULL;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "f:E:s:t:p:")) != -1) {
+        switch (opt) {
+        case 'f':
+            format = optarg;
+            if (strcmp(format, "text") != 0 && strcmp(format, "csv") != 0 &&
+                strcmp(format, "json") != 0)
+                usage();
+            break;
+        case 'E':
+            if (strcmp(optarg, "backtrack") == 0)
+                engines.push_back(ENGINE_BACKTRACK);
+            else if (strcmp(optarg, "memo") == 0)
+                engines.push_back(ENGINE_BACKTRACK_MEMO);
+            else if (strcmp(optarg, "pikevm") == 0)
+                engines.push_back(ENGINE_PIKEVM);
+            else if (strcmp(optarg, "dfa") == 0)
+                engines.push_back(ENGINE_DFA);
+            else
+                usage();
+            break;
+        case 's':
+            corpusBytes = (size_t) atol(optarg) << 10;
+            if (corpusBytes == 0)
+                usage();
+            break;
+        case 't':
+            minSeconds = atof(optarg);
+            if (minSeconds <= 0)
+                usage();
+            break;
+        case 'p':
+            filter = optarg;
+            break;
+        default:
+            usage();
+        }
+    }
+    if (optind != argc)
+        usage();
+    if (engines.empty()) {
+        engines.push_back(ENGINE_BACKTRACK);
+        engines.push_back(ENGINE_BACKTRACK_MEMO);
+        engines.push_back(ENGINE_PIKEVM);
+        engines.push_back(ENGINE_DFA);
+    }
+
+    Random rng(0x5eed);
+    vector<Corpus> corpora;
+    corpora.push_back(makeLogs(corpusBytes, rng));
+    corpora.push_back(makeCsv(corpusBytes, rng));
+    corpora.push_back(makeText(corpusBytes, rng));
+    corpora.push_back(makeDna(corpusBytes, rng));
+    corpora.push_back(makeRepeats(corpusBytes, rng));
+
+    vector<Result> results;
+    for (int i = 0; i < NUM_CASES; i++) {
+        const Case &c = CASES[i];
+        string name = string(c.corpus) + "/" + c.name;
+        if (filter && name.find(filter) == string::npos)
+            continue;
+
+        const Corpus *corpus = NULL;
+        for (size_t j = 0; j < corpora.size(); j++) {
+            if (corpora[j].name == c.corpus)
+                corpus = &corpora[j];
+        }
+
+        for (size_t e = 0; e < engines.size(); e++) {
+            // Progress goes to stderr, so that it stays out of the report.
+            fprintf(stderr, "%s %s %s\n", name.c_str(), c.call,
+                    engineName(engines[e]));
+            results.push_back(runCase(*corpus, c, engines[e], minSeconds));
+        }
+    }
+
+    if (strcmp(format, "csv") == 0)
+        printCsv(results);
+    else if (strcmp(format, "json") == 0)
+        printJson(results);
+    else
+        printText(results);
+    return 0;
+}
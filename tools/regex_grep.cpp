@@ -0,0 +1,327 @@
+/* regex_grep: prints the lines of a file that contain a match of a regex.
+ *
+ *   regex_grep [-n] [-b] [-c] [-j threads] [-E engine] pattern file
+ *
+ *   -n  prefix each line with its line number
+ *   -b  prefix each line with the byte offset of its first match
+ *   -c  only print the number of matching lines
+ *   -j  the number of worker threads (default: one per core)
+ *   -E  the engine to use: backtrack (default), memo, pikevm or dfa
+ *
+ * The file is memory-mapped and split into chunks that end at line breaks.
+ * Worker threads search the chunks in place, straight from the page cache,
+ * each with its own MatchScratch, and the main thread prints the results of
+ * each chunk in file order.
+ */
+
+#include "../engine.h"
+
+#include <climits>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <thread>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+
+// The size chunks are cut at, before being extended to the next line break.
+const size_t CHUNK_BYTES = 4 << 20;
+
+// How many chunks per worker may be searched ahead of the one being printed,
+// which bounds the memory used for the results waiting to be printed.
+const int CHUNKS_AHEAD = 4;
+
+
+struct Options {
+    bool lineNumbers;
+    bool byteOffsets;
+    bool countOnly;
+    int threads;
+    EngineType engine;
+
+    Options() : lineNumbers(false), byteOffsets(false), countOnly(false),
+        threads(0), engine(ENGINE_BACKTRACK) { }
+};
+
+
+/* A matching line, pointing into the mapped file. */
+struct Hit {
+    const char *line;
+    size_t len;
+
+    // The number of line breaks between the start of the chunk and the line.
+    long long lineIndex;
+
+    // Where the first match in the line starts, from the start of the line.
+    long long matchStart;
+};
+
+
+struct Chunk {
+    const char *begin;
+    const char *end;
+    vector<Hit> hits;
+
+    // The number of line breaks in the chunk; only counted for -n.
+    long long lineBreaks;
+
+    bool done;
+};
+
+
+/* Counts the line breaks in [begin, end). */
+static long long countLines(const char *begin, const char *end) {
+    long long n = 0;
+    while (begin < end) {
+        const char *p = (const char *) memchr(begin, '\n', end - begin);
+        if (p == NULL)
+            break;
+        n++;
+        begin = p + 1;
+    }
+    return n;
+}
+
+
+/* Searches every line of the chunk.  If the regex has a required literal,
+ * the lines that do not contain it are skipped over with the prefilter
+ * instead of being searched one by one.
+ */
+static void searchChunk(const CompiledRegex &regex, Chunk &chunk,
+                        MatchScratch &scratch, const Options &opts) {
+    const Prefilter &pf = regex.getPrefilter();
+    const char *p = chunk.begin;
+    const char *end = chunk.end;
+
+    // Line breaks before "counted" have been added to "lineIndex".
+    const char *counted = p;
+    long long lineIndex = 0;
+
+    while (p < end) {
+        // The prefilter takes int lengths.  Only a chunk holding a line of
+        // more than 2 GB is longer, and it is searched line by line.
+        if (!pf.empty() && end - p <= INT_MAX) {
+            int at = pf.next(p, end - p, 0);
+            if (at == -1)
+                break;
+
+            // Back up to the start of the line the literal is in.
+            const char *hit = p + at;
+            while (hit > p && hit[-1] != '\n')
+                hit--;
+            p = hit;
+        }
+
+        const char *eol = (const char *) memchr(p, '\n', end - p);
+        const char *lineEnd = eol == NULL ? end : eol;
+
+        // Lines longer than an int can index need 64-bit offsets.
+        size_t lineLen = lineEnd - p;
+        long long matchStart;
+        if (lineLen <= INT_MAX)
+            matchStart = find(regex, p, lineLen, scratch, opts.engine).start;
+        else
+            matchStart = findLong(regex, string_view(p, lineLen), scratch,
+                                  opts.engine).start;
+
+        if (matchStart != -1) {
+            if (opts.lineNumbers) {
+                lineIndex += countLines(counted, p);
+                counted = p;
+            }
+            Hit h = { p, lineLen, lineIndex, matchStart };
+            chunk.hits.push_back(h);
+        }
+
+        p = lineEnd + 1;
+    }
+
+    if (opts.lineNumbers)
+        chunk.lineBreaks = lineIndex + countLines(counted, end);
+}
+
+
+/* Splits the file into chunks of about CHUNK_BYTES that end just after a
+ * line break, or at the end of the file.
+ */
+static vector<Chunk> splitChunks(const char *data, size_t size) {
+    vector<Chunk> chunks;
+    const char *p = data;
+    const char *end = data + size;
+    while (p < end) {
+        const char *cut = end;
+        if ((size_t) (end - p) > CHUNK_BYTES) {
+            cut = (const char *) memchr(p + CHUNK_BYTES, '\n',
+                                        end - p - CHUNK_BYTES);
+            cut = cut == NULL ? end : cut + 1;
+        }
+
+        Chunk c;
+        c.begin = p;
+        c.end = cut;
+        c.lineBreaks = 0;
+        c.done = false;
+        chunks.push_back(c);
+        p = cut;
+    }
+    return chunks;
+}
+
+
+static void usage() {
+    fprintf(stderr, "usage: regex_grep [-n] [-b] [-c] [-j threads] "
+            "[-E backtrack|memo|pikevm|dfa] pattern file\n");
+    exit(2);
+}
+
+
+int main(int argc, char **argv) {
+    Options opts;
+    int opt;
+    while ((opt = getopt(argc, argv, "nbcj:E:")) != -1) {
+        switch (opt) {
+        case 'n':
+            opts.lineNumbers = true;
+            break;
+        case 'b':
+            opts.byteOffsets = true;
+            break;
+        case 'c':
+            opts.countOnly = true;
+            break;
+        case 'j':
+            opts.threads = atoi(optarg);
+            if (opts.threads < 1)
+                usage();
+            break;
+        case 'E':
+            if (strcmp(optarg, "backtrack") == 0)
+                opts.engine = ENGINE_BACKTRACK;
+            else if (strcmp(optarg, "memo") == 0)
+                opts.engine = ENGINE_BACKTRACK_MEMO;
+            else if (strcmp(optarg, "pikevm") == 0)
+                opts.engine = ENGINE_PIKEVM;
+            else if (strcmp(optarg, "dfa") == 0)
+                opts.engine = ENGINE_DFA;
+            else
+                usage();
+            break;
+        default:
+            usage();
+        }
+    }
+    if (argc - optind != 2)
+        usage();
+
+    if (opts.threads == 0) {
+        opts.threads = thread::hardware_concurrency();
+        if (opts.threads == 0)
+            opts.threads = 1;
+    }
+
+    CompiledRegex regex(argv[optind]);
+    const char *path = argv[optind + 1];
+
+    int fd = open(path, O_RDONLY);
+    struct stat st;
+    if (fd == -1 || fstat(fd, &st) == -1) {
+        perror(path);
+        return 2;
+    }
+
+    size_t size = st.st_size;
+    const char *data = NULL;
+    if (size > 0) {
+        void *mapped = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (mapped == MAP_FAILED) {
+            perror(path);
+            return 2;
+        }
+        madvise(mapped, size, MADV_SEQUENTIAL);
+        data = (const char *) mapped;
+    }
+    close(fd);
+
+    vector<Chunk> chunks = splitChunks(data, size);
+    int numChunks = chunks.size();
+
+    // Workers take chunks in order, staying at most a few chunks per
+    // worker ahead of the printer.
+    mutex lock;
+    condition_variable changed;
+    int nextChunk = 0;
+    int printed = 0;
+    int window = CHUNKS_AHEAD * opts.threads;
+
+    vector<thread> workers;
+    for (int t = 0; t < opts.threads && t < numChunks; t++) {
+        workers.push_back(thread([&]() {
+            MatchScratch scratch;
+            while (true) {
+                unique_lock<mutex> guard(lock);
+                changed.wait(guard, [&]() {
+                    return nextChunk >= numChunks ||
+                           nextChunk < printed + window;
+                });
+                if (nextChunk >= numChunks)
+                    return;
+                Chunk &chunk = chunks[nextChunk++];
+                guard.unlock();
+
+                searchChunk(regex, chunk, scratch, opts);
+
+                guard.lock();
+                chunk.done = true;
+                changed.notify_all();
+            }
+        }));
+    }
+
+    static char outBuf[1 << 16];
+    setvbuf(stdout, outBuf, _IOFBF, sizeof(outBuf));
+
+    long long count = 0;
+    long long lineBase = 1;
+    for (int k = 0; k < numChunks; k++) {
+        Chunk &chunk = chunks[k];
+        {
+            unique_lock<mutex> guard(lock);
+            changed.wait(guard, [&]() { return chunk.done; });
+        }
+
+        count += chunk.hits.size();
+        if (!opts.countOnly) {
+            for (const Hit &h : chunk.hits) {
+                if (opts.lineNumbers)
+                    printf("%lld:", lineBase + h.lineIndex);
+                if (opts.byteOffsets)
+                    printf("%lld:", (long long) (h.line - data) + h.matchStart);
+                fwrite(h.line, 1, h.len, stdout);
+                putchar('\n');
+            }
+        }
+        lineBase += chunk.lineBreaks;
+        vector<Hit>().swap(chunk.hits);
+
+        lock_guard<mutex> guard(lock);
+        printed = k + 1;
+        changed.notify_all();
+    }
+
+    for (thread &w : workers)
+        w.join();
+
+    if (opts.countOnly)
+        printf("%lld\n", count);
+    fflush(stdout);
+
+    if (data != NULL)
+        munmap((void *) data, size);
+    return count > 0 ? 0 : 1;
+}